@@ -0,0 +1,634 @@
+/***************************************************************************************************
+* Module Name: Conversion Kernel Microbenchmark
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This program measures the conversion functions of pressure_sensor.c on a set of ADC traces:
+*     - sweeps over the full 12-bit and 14-bit ADC ranges,
+*     - a random walk within the table bounds, modelling a slowly varying pressure,
+*     - uniform noise within the table bounds, where consecutive readings are unrelated (e.g. several
+*       multiplexed channels),
+*     - a saturated trace, where every reading is out of the table bounds.
+*   Every conversion mode is timed on every trace, and reported in ns/sample and cycles/sample.
+*
+*   Before the timings, every mode converts every ADC code from 0 to 65535, and is checked against the
+*   reference, the scalar ConvertADCReadingToPressure(...) with the generated descriptor (or, for the
+*   modes with the division-based interpolation, with the descriptor without the index and the slopes),
+*   and against a double-precision oracle: the exact linear interpolation of the table, and the fit
+*   outside of its bounds. Every divergence from the reference (beyond the maximum error of the fitted
+*   polynomial form, which is approximate by design) is reported, with the maximum and mean
+*   error from the oracle, and makes the benchmark exit with an error, so that no faster mode can trade
+*   away accuracy unnoticed. The rejection of a fit whose points all share one ADC reading is checked
+*   as well.
+*
+*   The modes that convert readings with fractional bits (Q8 readings, or 16x oversampled readings whose
+*   average has 4 fractional bits) are given a different fraction for every ADC code, and the calibration
+*   surface blends two different tables. None of these has an integer reference, so they are checked
+*   against their oracle, rounded, within 0.01 KPa for the rounding of the Q16 slopes (and of the Q15
+*   blend weight of the surface).
+*
+*   The benchmark is built with a variant of the generated header that includes the piecewise-polynomial
+*   form of the table (see the Makefile), so that every mode is always checked; "make test" runs the check.
+*
+*   On the desktop, time is measured with the monotonic clock and cycles with the time-stamp counter
+*   (x86 only). When built with -DBENCH_DWT for a Cortex-M3/M4/M7 target, cycles are measured with the
+*   DWT cycle counter instead, and ns/sample is derived from BENCH_CPU_HZ.
+*
+*   Usage: bench_pressure_sensor [--min-time-ms <ms>] [--accuracy-only]
+*
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pressure_lut_cache.h"
+#include "pressure_sensor.h"
+#include "pressure_simd.h"
+#include "pressure_table.h"
+
+#if defined(BENCH_DWT)
+// Data Watchpoint and Trace unit registers of the Cortex-M3/M4/M7.
+#define DEMCR (*(volatile uint32_t*)0xE000EDFCu)
+#define DWT_CTRL (*(volatile uint32_t*)0xE0001000u)
+#define DWT_CYCCNT (*(volatile uint32_t*)0xE0001004u)
+#define DEMCR_TRCENA (1u << 24)
+#define DWT_CTRL_CYCCNTENA (1u << 0)
+#ifndef BENCH_CPU_HZ
+#define BENCH_CPU_HZ 64000000u
+#endif
+// The traces are kept small enough to fit in the RAM of a microcontroller.
+#define TRACE_LENGTH 512
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_CYCLES 1
+#endif
+#define TRACE_LENGTH 65536
+#endif
+
+#define DEFAULT_MIN_TIME_MS 200
+// Largest decimation of a mode, and the number of ADC codes checked per call of the accuracy check.
+#define MAX_DECIMATION_SHIFT 4
+#define ACCURACY_CHUNK ((uint32_t)TRACE_LENGTH >> MAX_DECIMATION_SHIFT)
+// Readings of every half of the DMA buffer of the packed ring modes.
+#define RING_HALF_LENGTH 64
+// Shift of the 16 bit packed format, wide enough for the extrapolation of the generated table over every
+// ADC code, which bounds its quantization error.
+#define RING_16_SHIFT 3
+// Temperature the calibration surface is converted at, and the offsets of its second table from the
+// generated one.
+#define SURFACE_TEMPERATURE 2500
+#define SURFACE_ADC_OFFSET 97
+#define SURFACE_PRESSURE_OFFSET 150
+
+typedef struct {
+    const char* name;
+    uint16_t samples[TRACE_LENGTH];
+} Trace;
+
+typedef struct {
+    const char* name;
+    // Converts n samples to pressure readings with the given table descriptor.
+    void (*convert)(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t);
+    // Same, for the modes converting readings with inputFractionBits fractional bits instead.
+    void (*convertQ)(const uint32_t* in, int32_t* out, size_t n, const PressureTable* t);
+    const PressureTable* table;
+    // Every output is converted from 2^decimationShift input readings.
+    uint8_t decimationShift;
+    uint8_t inputFractionBits;
+    // Largest difference from the reference by design (0.01 KPa), e.g. the maximum error of a fitted form.
+    int32_t tolerance;
+    // Double-precision oracle of the mode, or NULL for that of the generated table.
+    double (*oracle)(double adcReading);
+} Mode;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;
+} Timestamp;
+
+static Trace traces[5];
+static int32_t output[TRACE_LENGTH];
+static uint16_t accuracyInput[TRACE_LENGTH];
+static uint32_t accuracyQInput[ACCURACY_CHUNK];
+// Trace of the mode being timed, with the fractional bits of the ...Q(...) modes.
+static uint32_t traceQ[TRACE_LENGTH];
+// Checksum of all the outputs, printed so that the compiler cannot discard the conversions.
+static uint32_t checksum;
+// Descriptor of the generated table without the index and the slopes, i.e. the binary search and the
+// division-based interpolation.
+static PressureTable referenceTable;
+// Descriptor of the generated table with the Eytzinger layout instead of the binary search.
+static PressureTable eytzingerTable;
+static PressureEytzinger eytzingerLayout;
+static uint16_t eytzingerKeys[PRESSURE_EYTZINGER_SLOTS(PRESSURE_TABLE_SIZE)];
+static uint16_t eytzingerRanks[PRESSURE_EYTZINGER_SLOTS(PRESSURE_TABLE_SIZE)];
+// Descriptor of the generated table with its dense table of every ADC reading.
+static PressureTable lutTable;
+static int32_t lut[PRESSURE_LUT_SIZE];
+// Paged cache of the dense table, with a pool for every page. The pages are filled on the first pass.
+static PressureLUTCache lutCache;
+static int32_t lutCachePool[PRESSURE_LUT_PAGE_COUNT * PRESSURE_LUT_PAGE_SIZE];
+// Calibration surface of the generated table at 0 and of a second table at 50 C, with its ADC readings
+// and pressures offset, converted between the two temperatures, so that both rows are blended.
+static PressureTable surfaceRows[2];
+static PressureTableEntry surfaceEntries[PRESSURE_TABLE_SIZE + 1];
+static int32_t surfaceSlopes[PRESSURE_TABLE_SIZE];
+static PressureIndex surfaceIndex;
+static uint8_t surfaceIndexSegments[(UINT16_MAX >> PRESSURE_INDEX_SHIFT) + 1];
+static const int16_t surfaceTemperatures[2] = { 0, 5000 };
+static const PressureSurface surface = { surfaceRows, surfaceTemperatures, 2 };
+static PressureSurfaceState surfaceState;
+// Conversion context of the channel of the tracked mode.
+static PressureTracker tracker;
+// Rings over a circular DMA buffer, with the packed pressures in place of the ADC readings in 16 bits,
+// and in a ring of their own in 24 bits.
+static uint16_t ring16ADC[2 * RING_HALF_LENGTH];
+static PressureRing ring16;
+static uint16_t ring24ADC[2 * RING_HALF_LENGTH];
+static uint8_t ring24Pressures[2 * RING_HALF_LENGTH * 3];
+static PressureRing ring24;
+// Formats of the ...Q(...) modes, in 0.01 KPa.
+static const PressureQFormat formatQ0 = PRESSURE_Q_FORMAT(0, FIXED_POINT_ARITH);
+static const PressureQFormat formatQ8 = PRESSURE_Q_FORMAT(8, FIXED_POINT_ARITH);
+
+/* Converts every sample with its own call to ConvertADCReadingToPressure(...), as done per ISR tick. */
+static void ConvertEachReading(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ConvertADCReadingToPressure(in[i], t);
+    }
+}
+
+/* Converts every sample with its own call, as done per ISR tick, through the context of the channel. */
+static void ConvertEachReadingTracked(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ConvertADCReadingToPressureTracked(in[i], &tracker);
+    }
+}
+
+/* The compact table has its own conversion functions, so these ignore the descriptor of the mode and
+*  convert with the compact form of the generated table.
+*/
+static void ConvertEachReadingCompact(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ConvertADCReadingToPressureCompact(in[i], &pressureTableCompact);
+    }
+}
+
+static void ConvertBufferCompact(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    ConvertADCBufferToPressureCompact(in, out, n, &pressureTableCompact);
+}
+
+static void ConvertBufferLUTCache(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    PressureLUTCache_ConvertBuffer(&lutCache, in, out, n);
+}
+
+static void ConvertBufferSurface(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    ConvertADCBufferToPressureSurface(in, out, n, &surfaceState);
+}
+
+#if defined(PRESSURE_TABLE_HAS_POLY)
+static void ConvertBufferPoly(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    ConvertADCBufferToPressurePoly(in, out, n, &pressureTablePoly);
+}
+#endif
+
+/* 16x oversampled readings, decimated and converted in one pass. Timed per input reading. */
+static void ConvertBufferDecimated(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    ConvertADCBufferToPressureDecimated(in, out, n >> 4, 4, t);
+}
+
+static void ConvertBufferQ0(const uint32_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    ConvertADCBufferToPressureQ(in, out, n, t, &formatQ0);
+}
+
+static void ConvertBufferQ8(const uint32_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    ConvertADCBufferToPressureQ(in, out, n, t, &formatQ8);
+}
+
+/* Feeds the samples through the ring half by half, as the DMA would, and unpacks every converted half.
+*  Every call starts with the first half, whatever half the previous call ended with.
+*/
+static void ConvertThroughRing(PressureRing* ringPtr, uint16_t* adc, const uint16_t* in, int32_t* out, size_t n) {
+    uint8_t half = 0;
+
+    for (size_t first = 0; first < n; first += RING_HALF_LENGTH) {
+        size_t length = ((n - first) < RING_HALF_LENGTH) ? (n - first) : RING_HALF_LENGTH;
+        const uint8_t* packed;
+
+        memcpy(&adc[half * RING_HALF_LENGTH], &in[first], length * sizeof(*in));
+        if (half == 0) {
+            PressureRing_OnHalfComplete(ringPtr);
+        }
+        else {
+            PressureRing_OnComplete(ringPtr);
+        }
+        packed = PressureRing_Acquire(ringPtr);
+        for (size_t i = 0; i < length; i++) {
+            out[first + i] = PressurePacked_Get(&ringPtr->format, packed, i);
+        }
+        PressureRing_Release(ringPtr);
+        half ^= 1;
+    }
+}
+
+static void ConvertBufferRing16(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    ConvertThroughRing(&ring16, ring16ADC, in, out, n);
+}
+
+static void ConvertBufferRing24(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    (void)t;
+    ConvertThroughRing(&ring24, ring24ADC, in, out, n);
+}
+
+/* Sets up the rings of the packed modes. The 16 bit format starts from the lowest pressure of any ADC
+*  code, so that none saturates.
+*/
+static void InitRings(void) {
+    PressurePackedFormat format16 = { PRESSURE_PACKED_16, INT32_MAX, RING_16_SHIFT };
+    const PressurePackedFormat format24 = { PRESSURE_PACKED_24, 0, 0 };
+
+    for (uint32_t adcReading = 0; adcReading < PRESSURE_LUT_SIZE; adcReading++) {
+        if (lut[adcReading] < format16.offset) {
+            format16.offset = lut[adcReading];
+        }
+    }
+    PressureRing_Init(&ring16, &pressureTableDescriptor, ring16ADC, NULL, RING_HALF_LENGTH, &format16);
+    PressureRing_Init(&ring24, &pressureTableDescriptor, ring24ADC, ring24Pressures, RING_HALF_LENGTH, &format24);
+}
+
+static Timestamp Now(void) {
+    Timestamp now;
+#if defined(BENCH_DWT)
+    now.cycles = DWT_CYCCNT;
+    now.ns = 0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now.ns = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#if defined(BENCH_HAS_CYCLES)
+    now.cycles = __rdtsc();
+#else
+    now.cycles = 0;
+#endif
+#endif
+    return now;
+}
+
+static void TimerInit(void) {
+#if defined(BENCH_DWT)
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+}
+
+/* Deterministic pseudo-random generator, so that every run converts the same traces. */
+static uint32_t NextRandom(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 16;
+}
+
+static void BuildTraces(void) {
+    const uint16_t minADC = pressureTable[0].adc;
+    const uint16_t maxADC = pressureTable[PRESSURE_TABLE_SIZE].adc;
+    uint32_t state = 12345;
+    int32_t walk = (minADC + maxADC) / 2;
+
+    traces[0].name = "sweep 12-bit";
+    traces[1].name = "sweep 14-bit";
+    traces[2].name = "random walk";
+    traces[3].name = "saturated";
+    traces[4].name = "uniform noise";
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++) {
+        traces[0].samples[i] = (uint16_t)((i * 4096u / TRACE_LENGTH) & 0x0FFF);
+        traces[1].samples[i] = (uint16_t)((i * 16384u / TRACE_LENGTH) & 0x3FFF);
+
+        // Steps of up to +/-8 ADC counts, reflected at the table bounds.
+        walk += (int32_t)(NextRandom(&state) % 17) - 8;
+        if (walk < minADC) {
+            walk = 2 * minADC - walk;
+        }
+        if (walk > maxADC) {
+            walk = 2 * maxADC - walk;
+        }
+        traces[2].samples[i] = (uint16_t)walk;
+
+        // A sensor stuck at either rail, with a little noise.
+        traces[3].samples[i] = (uint16_t)(((i / 4096) % 2 == 0) ? (NextRandom(&state) % 16) : (16383 - NextRandom(&state) % 16));
+
+        traces[4].samples[i] = (uint16_t)(minADC + NextRandom(&state) % (maxADC - minADC + 1));
+    }
+}
+
+/* The double-precision oracle of a table: its exact linear interpolation within the table bounds, and
+*  its fit outside of them.
+*/
+static double TableOracle(const PressureTable* t, double adcReading) {
+    const PressureTableEntry* entries = t->entries;
+    int16_t segment = 0;
+
+    if ((adcReading < entries[0].adc) || (adcReading > entries[t->tableSize].adc)) {
+        return (double)t->fit.slope * adcReading + (double)t->fit.intercept;
+    }
+    while ((segment < (t->tableSize - 1)) && (adcReading >= entries[segment + 1].adc)) {
+        segment++;
+    }
+    return entries[segment].pressure + (double)(entries[segment + 1].pressure - entries[segment].pressure)
+                                       * (adcReading - entries[segment].adc) / (entries[segment + 1].adc - entries[segment].adc);
+}
+
+/* The oracle of the calibration surface: the linear blend of both tables at the temperature. */
+static double SurfaceOracle(double adcReading) {
+    const double weight = (double)(SURFACE_TEMPERATURE - surfaceTemperatures[0]) / (surfaceTemperatures[1] - surfaceTemperatures[0]);
+    return (1.0 - weight) * TableOracle(&surfaceRows[0], adcReading) + weight * TableOracle(&surfaceRows[1], adcReading);
+}
+
+/* Fractional part, with fractionBits bits, of the reading of the given ADC code in the accuracy check and
+*  in the traces of the modes with fractional readings. It differs between consecutive codes, so that every
+*  fraction is converted. The last code has none, so that an oversampled reading stays within 16 bits.
+*/
+static uint32_t FractionOf(uint16_t adcCode, uint8_t fractionBits) {
+    return (adcCode == UINT16_MAX) ? 0 : (((uint32_t)adcCode * 157u) & ((1u << fractionBits) - 1u));
+}
+
+/* Converts every ADC code with the mode, in ascending order, and reports its divergences from the
+*  reference and its error from the oracle. Returns the number of divergences.
+*/
+static uint32_t CheckAccuracy(const Mode* mode) {
+    // The modes with the division-based interpolation are checked against the descriptor without the
+    // slopes, and the others against the generated descriptor, which computes every reading rather than
+    // reading it back from a dense table.
+    const PressureTable* referencePtr = ((mode->table != NULL) && (mode->table->slopes == NULL)) ? &referenceTable : &pressureTableDescriptor;
+    // The readings with fractional bits, and the modes with their own oracle, have no integer reference,
+    // and are checked against the oracle, rounded, instead.
+    const uint8_t fractionBits = mode->decimationShift + mode->inputFractionBits;
+    const int hasReference = (fractionBits == 0) && (mode->oracle == NULL);
+    uint32_t divergences = 0;
+    uint32_t firstDivergence = 0;
+    double maxError = 0.0;
+    double sumOfErrors = 0.0;
+
+    for (uint32_t chunkStart = 0; chunkStart < PRESSURE_LUT_SIZE; chunkStart += ACCURACY_CHUNK) {
+        for (uint32_t i = 0; i < ACCURACY_CHUNK; i++) {
+            const uint16_t adcCode = (uint16_t)(chunkStart + i);
+            const uint32_t fraction = FractionOf(adcCode, fractionBits);
+
+            if (mode->convertQ != NULL) {
+                accuracyQInput[i] = ((uint32_t)adcCode << fractionBits) + fraction;
+            }
+            else {
+                // The oversampled readings are the code, and the code + 1 for the first "fraction" of
+                // them, so that their sum has the fractional bits of the code.
+                for (uint32_t k = 0; k < (1u << mode->decimationShift); k++) {
+                    accuracyInput[(i << mode->decimationShift) + k] = (uint16_t)(adcCode + (k < fraction));
+                }
+            }
+        }
+        if (mode->convertQ != NULL) {
+            mode->convertQ(accuracyQInput, output, ACCURACY_CHUNK, mode->table);
+        }
+        else {
+            mode->convert(accuracyInput, output, ACCURACY_CHUNK << mode->decimationShift, mode->table);
+        }
+
+        for (uint32_t i = 0; i < ACCURACY_CHUNK; i++) {
+            const uint16_t adcCode = (uint16_t)(chunkStart + i);
+            const double adcReading = adcCode + (double)FractionOf(adcCode, fractionBits) / (1u << fractionBits);
+            const double oracle = (mode->oracle != NULL) ? mode->oracle(adcReading) : TableOracle(&pressureTableDescriptor, adcReading);
+            double error = output[i] - oracle;
+            int32_t reference = hasReference ? ConvertADCReadingToPressure(adcCode, referencePtr)
+                                             : (int32_t)((oracle < 0.0) ? (oracle - 0.5) : (oracle + 0.5));
+            int32_t difference = output[i] - reference;
+
+            if ((difference > mode->tolerance) || (difference < -mode->tolerance)) {
+                if (divergences == 0) {
+                    firstDivergence = adcCode;
+                }
+                divergences++;
+            }
+            error = (error < 0.0) ? -error : error;
+            maxError = (error > maxError) ? error : maxError;
+            sumOfErrors += error;
+        }
+    }
+
+    printf("%-28s %11lu", mode->name, (unsigned long)divergences);
+    if (divergences > 0) {
+        printf(" %8lu", (unsigned long)firstDivergence);
+    }
+    else {
+        printf(" %8s", "-");
+    }
+    printf(" %10.3f %10.4f\n", maxError, sumOfErrors / PRESSURE_LUT_SIZE);
+    return divergences;
+}
+
+/* Checks the ...Q(...) conversion of the readings out of the table bounds, up to the 16 bit rails and the
+*  largest 32 bit reading, in Q0 and Q16 and up to the largest output scale (1000000 units per KPa), against
+*  the exact extrapolation by the fit, rounded and saturated to 32 bits. Returns the number of failures.
+*/
+static uint32_t CheckQRails(void) {
+    static const PressureQFormat formats[] = { PRESSURE_Q_FORMAT(0, FIXED_POINT_ARITH), PRESSURE_Q_FORMAT(0, 1000), PRESSURE_Q_FORMAT(0, 1000000),
+                                               PRESSURE_Q_FORMAT(16, FIXED_POINT_ARITH), PRESSURE_Q_FORMAT(16, 1000), PRESSURE_Q_FORMAT(16, 1000000) };
+    static const int64_t unitsPerKPa[] = { FIXED_POINT_ARITH, 1000, 1000000, FIXED_POINT_ARITH, 1000, 1000000 };
+    const PressureTable* t = &pressureTableDescriptor;
+    uint32_t failures = 0;
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        const uint8_t bits = formats[f].inputFractionBits;
+        const uint32_t readings[] = { 0, (uint32_t)(t->entries[0].adc - 1) << bits, (uint32_t)(t->entries[t->tableSize].adc + 1) << bits,
+                                      (uint32_t)UINT16_MAX << bits, UINT32_MAX };
+
+        for (size_t r = 0; r < sizeof(readings) / sizeof(readings[0]); r++) {
+            // The extrapolation in 0.01 KPa with bits fractional bits, then in the output unit, rounded.
+            int64_t expected = (t->fit.slope * readings[r] + t->fit.intercept * ((int64_t)1 << bits)) * (unitsPerKPa[f] / FIXED_POINT_ARITH);
+            expected = (bits == 0) ? expected : ((expected + ((int64_t)1 << (bits - 1))) >> bits);
+            expected = (expected > INT32_MAX) ? INT32_MAX : ((expected < INT32_MIN) ? INT32_MIN : expected);
+            if (ConvertADCReadingToPressureQ(readings[r], t, &formats[f]) != expected) {
+                failures++;
+            }
+        }
+    }
+    printf("%-28s %11lu\n", "Q output at the rails", (unsigned long)failures);
+    return failures;
+}
+
+/* Checks that the fit of points which all share one ADC reading is rejected, and that such a table
+*  extrapolates to 0 as documented by PressureFit_Init(...). Returns the number of failed checks.
+*/
+static uint32_t CheckDegenerateFit(void) {
+    const PressureTableEntry entries[3] = { { 10000, 1000 }, { 20000, 1000 }, { 30000, 1000 } };
+    PressureFitAccumulator accumulator;
+    PressureFit fit = { 1, 1 };
+    uint32_t failures = 0;
+
+    PressureFitAccumulator_Init(&accumulator);
+    for (int i = 0; i < 3; i++) {
+        PressureFitAccumulator_Add(&accumulator, entries[i].pressure, entries[i].adc);
+    }
+    if ((PressureFitAccumulator_GetFit(&accumulator, &fit) != -1) || (fit.slope != 1) || (fit.intercept != 1)) {
+        failures++;
+    }
+    PressureFit_Init(&fit, entries, 2);
+    if ((fit.slope != 0) || (fit.intercept != 0)) {
+        failures++;
+    }
+    printf("%-28s %11lu\n\n", "fit of one ADC reading", (unsigned long)failures);
+    return failures;
+}
+
+/* Runs the mode on the trace until at least minTimeNs has elapsed (or a fixed number of passes with the
+*  DWT cycle counter), and reports the fastest pass, which is the least disturbed by the environment.
+*/
+static void RunBenchmark(const Mode* mode, const Trace* trace, uint64_t minTimeNs) {
+    uint64_t bestNs = UINT64_MAX;
+    uint64_t bestCycles = UINT64_MAX;
+    uint64_t elapsedNs = 0;
+    uint32_t passes = 0;
+
+    if (mode->convertQ != NULL) {
+        for (size_t i = 0; i < TRACE_LENGTH; i++) {
+            traceQ[i] = ((uint32_t)trace->samples[i] << mode->inputFractionBits) + FractionOf(trace->samples[i], mode->inputFractionBits);
+        }
+    }
+    do {
+        Timestamp start = Now();
+        if (mode->convertQ != NULL) {
+            mode->convertQ(traceQ, output, TRACE_LENGTH, mode->table);
+        }
+        else {
+            mode->convert(trace->samples, output, TRACE_LENGTH, mode->table);
+        }
+        Timestamp end = Now();
+
+        if ((end.ns - start.ns) < bestNs) {
+            bestNs = end.ns - start.ns;
+        }
+        if ((end.cycles - start.cycles) < bestCycles) {
+            bestCycles = end.cycles - start.cycles;
+        }
+        elapsedNs += end.ns - start.ns;
+        passes++;
+        for (size_t i = 0; i < TRACE_LENGTH; i++) {
+            checksum = checksum * 31u + (uint32_t)output[i];
+        }
+#if defined(BENCH_DWT)
+    } while (passes < 16);
+    (void)minTimeNs;
+    (void)elapsedNs;
+    bestNs = bestCycles * 1000000000u / BENCH_CPU_HZ;
+#else
+    } while ((elapsedNs < minTimeNs) || (passes < 3));
+#endif
+
+    printf("%-28s %-14s %10.3f", mode->name, trace->name, (double)bestNs / TRACE_LENGTH);
+#if defined(BENCH_DWT) || defined(BENCH_HAS_CYCLES)
+    printf(" %14.2f\n", (double)bestCycles / TRACE_LENGTH);
+#else
+    printf(" %14s\n", "n/a");
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t minTimeMs = DEFAULT_MIN_TIME_MS;
+    int accuracyOnly = 0;
+    uint32_t divergences = 0;
+    const Mode modes[] = {
+        { "reading, binary search", ConvertEachReading, NULL, &referenceTable, 0, 0, 0, NULL },
+        { "reading, eytzinger", ConvertEachReading, NULL, &eytzingerTable, 0, 0, 0, NULL },
+        { "reading, index + slopes", ConvertEachReading, NULL, &pressureTableDescriptor, 0, 0, 0, NULL },
+        { "reading, compact", ConvertEachReadingCompact, NULL, NULL, 0, 0, 0, NULL },
+        { "reading, tracked", ConvertEachReadingTracked, NULL, NULL, 0, 0, 0, NULL },
+        { "buffer, binary search", ConvertADCBufferToPressure, NULL, &referenceTable, 0, 0, 0, NULL },
+        { "buffer, eytzinger", ConvertADCBufferToPressure, NULL, &eytzingerTable, 0, 0, 0, NULL },
+        { "buffer, index + slopes", ConvertADCBufferToPressure, NULL, &pressureTableDescriptor, 0, 0, 0, NULL },
+        { "buffer, compact", ConvertBufferCompact, NULL, NULL, 0, 0, 0, NULL },
+        { "buffer, vector", ConvertADCBufferToPressureVector, NULL, &pressureTableDescriptor, 0, 0, 0, NULL },
+        { "reading, full LUT", ConvertEachReading, NULL, &lutTable, 0, 0, 0, NULL },
+        { "buffer, full LUT", ConvertADCBufferToPressure, NULL, &lutTable, 0, 0, 0, NULL },
+        { "buffer, full LUT vector", ConvertADCBufferToPressureVector, NULL, &lutTable, 0, 0, 0, NULL },
+        { "buffer, paged LUT cache", ConvertBufferLUTCache, NULL, NULL, 0, 0, 0, NULL },
+        { "buffer, 16x decimated", ConvertBufferDecimated, NULL, &pressureTableDescriptor, 4, 0, 1, NULL },
+        { "buffer, 2D surface", ConvertBufferSurface, NULL, NULL, 0, 0, 1, SurfaceOracle },
+        { "buffer, AVR kernel", ConvertADCBufferToPressureAVR, NULL, &pressureTableDescriptor, 0, 0, 0, NULL },
+        { "buffer, Q0 readings", NULL, ConvertBufferQ0, &pressureTableDescriptor, 0, 0, 0, NULL },
+        { "buffer, Q8 readings", NULL, ConvertBufferQ8, &pressureTableDescriptor, 0, 8, 1, NULL },
+        { "buffer, packed 16-bit ring", ConvertBufferRing16, NULL, NULL, 0, 0, (1 << RING_16_SHIFT) - 1, NULL },
+        { "buffer, packed 24-bit ring", ConvertBufferRing24, NULL, NULL, 0, 0, 0, NULL },
+#if defined(PRESSURE_TABLE_HAS_POLY)
+        { "buffer, polynomial", ConvertBufferPoly, NULL, NULL, 0, 0, PRESSURE_TABLE_POLY_MAX_ERROR, NULL },
+#endif
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "--min-time-ms") == 0) && ((i + 1) < argc)) {
+            minTimeMs = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--accuracy-only") == 0) {
+            accuracyOnly = 1;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--min-time-ms <ms>] [--accuracy-only]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    TimerInit();
+    PressureTable_Init(&referenceTable, pressureTable, PRESSURE_TABLE_SIZE, NULL, NULL);
+    eytzingerTable = referenceTable;
+    PressureEytzinger_Init(&eytzingerLayout, eytzingerKeys, eytzingerRanks, pressureTable, PRESSURE_TABLE_SIZE);
+    eytzingerTable.eytzinger = &eytzingerLayout;
+    lutTable = pressureTableDescriptor;
+    PressureTable_InitLUT(&lutTable, lut);
+    PressureLUTCache_Init(&lutCache, &pressureTableDescriptor, lutCachePool, PRESSURE_LUT_PAGE_COUNT);
+    surfaceRows[0] = pressureTableDescriptor;
+    for (int16_t i = 0; i <= PRESSURE_TABLE_SIZE; i++) {
+        surfaceEntries[i].pressure = pressureTable[i].pressure + SURFACE_PRESSURE_OFFSET;
+        surfaceEntries[i].adc = (uint16_t)(pressureTable[i].adc + SURFACE_ADC_OFFSET);
+    }
+    PressureIndex_Init(&surfaceIndex, surfaceIndexSegments, surfaceEntries, PRESSURE_TABLE_SIZE);
+    PressureSlopes_Init(surfaceSlopes, surfaceEntries, PRESSURE_TABLE_SIZE);
+    PressureTable_Init(&surfaceRows[1], surfaceEntries, PRESSURE_TABLE_SIZE, &surfaceIndex, surfaceSlopes);
+    PressureSurface_Init(&surfaceState, &surface, SURFACE_TEMPERATURE);
+    InitRings();
+    PressureTracker_Init(&tracker, &pressureTableDescriptor);
+    BuildTraces();
+
+    // Errors in 0.01 KPa, over every ADC code.
+    printf("%-28s %11s %8s %10s %10s\n", "mode", "divergences", "first", "max error", "mean error");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        divergences += CheckAccuracy(&modes[m]);
+    }
+    printf("\n");
+    divergences += CheckQRails();
+    divergences += CheckDegenerateFit();
+    if (accuracyOnly) {
+        return (divergences == 0) ? 0 : 1;
+    }
+    // The check filled every page, so the timed passes start again from an empty cache.
+    PressureLUTCache_Reset(&lutCache);
+
+    printf("%-28s %-14s %10s %14s\n", "mode", "trace", "ns/sample", "cycles/sample");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (size_t t = 0; t < sizeof(traces) / sizeof(traces[0]); t++) {
+            RunBenchmark(&modes[m], &traces[t], minTimeMs * 1000000u);
+        }
+    }
+    printf("tracked: %.2f%% of the readings within the table bounds found without a search\n",
+           100.0 * tracker.hits / ((tracker.hits + tracker.misses) ? (tracker.hits + tracker.misses) : 1));
+    printf("paged LUT cache: %u pages filled, %llu hits\n", lutCache.usedPages, (unsigned long long)lutCache.hits);
+    printf("checksum: %08lx\n", (unsigned long)checksum);
+    return (divergences == 0) ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Compile-Time Converter Check (C++17)
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This desktop test checks that pressure::PressureConverter<Table> (pressure_converter.hpp) is
+*   bit-identical to the C entry point ConvertADCReadingToPressure(...), with the descriptor the table
+*   generator would emit for the same table, on every 16-bit ADC code and on out-of-range readings. The
+*   tables cover each search and interpolation of the converter:
+*     - pressureTable, searched with the direct segment index and interpolated with the slopes;
+*     - a table of 13 segments, searched with the unrolled compare-and-count;
+*     - a table of 4 segments with pressure steps beyond 15 bits, interpolated with the division;
+*     - a table of 299 segments, too many for the index, searched with the binary search.
+*   Every divergence is counted and the first one is reported, and any divergence makes the test exit
+*   with an error. It is built and run by "make test-cxx".
+*
+***************************************************************************************************/
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+
+#include "pressure_converter.hpp"
+
+// Number of segments of the generated large table, beyond the index.
+#define LARGE_TABLE_SIZE 299
+
+struct SmallTableData {
+    static constexpr PressureTableEntry entries[] = {
+        { 10000, 1696 }, { 11000, 1909 }, { 12000, 2118 }, { 13000, 2272 }, { 14000, 2366 },
+        { 15000, 2448 }, { 16000, 2570 }, { 17000, 2745 }, { 18000, 2931 }, { 19000, 3073 },
+        { 20000, 3151 }, { 21000, 3200 }, { 22000, 3278 }, { 23000, 3411 }
+    };
+};
+
+struct WideStepTableData {
+    static constexpr PressureTableEntry entries[] = { { 0, 1000 }, { 50000, 2000 }, { 60000, 3000 }, { 100000, 5000 }, { 99000, 6000 } };
+};
+
+/* Entries of the large table, with uneven ADC and pressure steps. */
+static constexpr std::array<PressureTableEntry, LARGE_TABLE_SIZE + 1> GenerateLargeTable() noexcept {
+    std::array<PressureTableEntry, LARGE_TABLE_SIZE + 1> entries = {};
+
+    for (int16_t i = 0; i <= LARGE_TABLE_SIZE; i++) {
+        entries[i].pressure = 100 * i + (i * i) % 47;
+        entries[i].adc = static_cast<uint16_t>(1000 + 37 * i + (i % 5));
+    }
+    return entries;
+}
+
+struct LargeTableData {
+    static constexpr std::array<PressureTableEntry, LARGE_TABLE_SIZE + 1> entries = GenerateLargeTable();
+};
+
+/* Builds the descriptor the table generator would emit for the table: with the direct segment index and
+*  the slopes whenever they can represent it.
+*/
+template <typename Table>
+static void InitDescriptor(PressureTable* tablePtr) {
+    static PressureIndex index;
+    static uint8_t indexSegments[PRESSURE_INDEX_BUCKETS(0, UINT16_MAX)];
+    static int32_t slopes[std::size(Table::entries) - 1];
+    const PressureTableEntry* entries = std::data(Table::entries);
+    const int16_t tableSize = static_cast<int16_t>(std::size(Table::entries) - 1);
+    const bool hasIndex = (PressureIndex_Init(&index, indexSegments, entries, tableSize) >= 0);
+    const bool hasSlopes = (PressureSlopes_Init(slopes, entries, tableSize) == 0);
+
+    PressureTable_Init(tablePtr, entries, tableSize, hasIndex ? &index : NULL, hasSlopes ? slopes : NULL);
+}
+
+/* Compares the converter with ConvertADCReadingToPressure(...) on every ADC code and on out-of-range
+*  readings. Returns the number of divergences.
+*/
+template <typename Table>
+static uint32_t CheckConverter(const char* name, const PressureTable* descriptor) {
+    static const int outOfRangeReadings[] = { -1000000, -65536, -1, 65536, 65537, 1000000 };
+    uint32_t divergences = 0;
+    int firstDivergence = 0;
+
+    for (int adcReading = 0; adcReading <= UINT16_MAX; adcReading++) {
+        if (pressure::PressureConverter<Table>::Convert(adcReading) != ConvertADCReadingToPressure(adcReading, descriptor)) {
+            firstDivergence = (divergences == 0) ? adcReading : firstDivergence;
+            divergences++;
+        }
+    }
+    for (int adcReading : outOfRangeReadings) {
+        if (pressure::PressureConverter<Table>::Convert(adcReading) != ConvertADCReadingToPressure(adcReading, descriptor)) {
+            firstDivergence = (divergences == 0) ? adcReading : firstDivergence;
+            divergences++;
+        }
+    }
+
+    if (divergences == 0) {
+        printf("%-40s %10u %12s\n", name, divergences, "-");
+    }
+    else {
+        printf("%-40s %10u %12d\n", name, divergences, firstDivergence);
+    }
+    return divergences;
+}
+
+int main() {
+    PressureTable smallTable;
+    PressureTable wideStepTable;
+    PressureTable largeTable;
+    uint32_t divergences = 0;
+
+    InitDescriptor<SmallTableData>(&smallTable);
+    InitDescriptor<WideStepTableData>(&wideStepTable);
+    InitDescriptor<LargeTableData>(&largeTable);
+
+    printf("%-40s %10s %12s\n", "converter", "divergences", "first code");
+    divergences += CheckConverter<pressure::PressureTableData>("pressureTable, index + slopes", &pressureTableDescriptor);
+    divergences += CheckConverter<SmallTableData>("13 segments, unrolled", &smallTable);
+    divergences += CheckConverter<WideStepTableData>("4 segments, division", &wideStepTable);
+    divergences += CheckConverter<LargeTableData>("299 segments, binary search", &largeTable);
+    return (divergences == 0) ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - 8-bit AVR Kernel
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts ADC readings on 8-bit AVR microcontrollers with the generated table descriptors
+*   left in program memory, where PRESSURE_FLASH_DATA places them on AVR. Every field of the descriptor
+*   and every table access goes through pgm_read_byte/word/dword, so neither the table nor its descriptor
+*   is copied to RAM. The arithmetic avoids the 64-bit (and, with the slopes, any) libgcc multiply and
+*   division routines:
+*     - The Q16 slope of a segment is a precomputed reciprocal of its ADC step, split into its high and
+*       low 16 bits: slope * (ADC - ADC1) is the 16x16->32 product of the high half, plus the high half of
+*       the 16x16->32 product of the low half, rounded exactly as by the 32-bit multiply.
+*     - The extrapolation result is truncated to 32 bits, so it only depends on the low 32 bits of the
+*       fit, and is computed from two 16x16->32 products modulo 2^32.
+*   The results are bit-identical to ConvertADCReadingToPressure(...) on the same descriptor. Without the
+*   segment slopes, the interpolation falls back to the original 32-bit division, and without the direct
+*   segment index, to the binary search. The Eytzinger layout and the dense table are not used on AVR.
+*
+*   The descriptor and its tables must be in the lower 64 KB of program memory (pgm_read_*_near). On
+*   other targets, program memory is ordinary memory, so the module is built with plain reads (e.g. to
+*   check it against ConvertADCReadingToPressure(...) on the desktop). The AVR build itself has not been
+*   tested with avr-gcc or on hardware.
+*
+***************************************************************************************************/
+
+#include <stddef.h>
+
+#include "pressure_sensor.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define READ_BYTE(address) pgm_read_byte(address)
+#define READ_WORD(address) pgm_read_word(address)
+#define READ_DWORD(address) pgm_read_dword(address)
+// Data pointers are 16 bits wide on AVR.
+#define READ_POINTER(address) ((const void*)pgm_read_word(address))
+// AVR is little-endian, so the low 32 bits of a 64-bit fit are its first 4 bytes.
+#define READ_LOW_DWORD(address) pgm_read_dword(address)
+#else
+#define READ_BYTE(address) (*(const uint8_t*)(address))
+#define READ_WORD(address) (*(const uint16_t*)(address))
+#define READ_DWORD(address) (*(const uint32_t*)(address))
+#define READ_POINTER(address) ((const void*)*(address))
+#define READ_LOW_DWORD(address) ((uint32_t)*(address))
+#endif
+
+// Fields of a descriptor in program memory, read once per conversion or buffer.
+typedef struct {
+    const PressureTableEntry* entries;
+    int16_t tableSize;
+    uint16_t minADC;
+    uint16_t maxADC;
+    uint32_t fitSlope;
+    uint32_t fitIntercept;
+    const PressureIndex* index;
+    const uint8_t* indexSegments;
+    uint16_t firstBucket;
+    const int32_t* slopes;
+} AVRTable;
+
+static uint16_t EntryADC(const PressureTableEntry* entries, int16_t i) {
+    return READ_WORD(&entries[i].adc);
+}
+
+static int32_t EntryPressure(const PressureTableEntry* entries, int16_t i) {
+    return (int32_t)READ_DWORD(&entries[i].pressure);
+}
+
+static void ReadTable(const PressureTable* tablePtr, AVRTable* t) {
+    t->entries = (const PressureTableEntry*)READ_POINTER(&tablePtr->entries);
+    t->tableSize = (int16_t)READ_WORD(&tablePtr->tableSize);
+    t->minADC = EntryADC(t->entries, 0);
+    t->maxADC = EntryADC(t->entries, t->tableSize);
+    t->fitSlope = READ_LOW_DWORD(&tablePtr->fit.slope);
+    t->fitIntercept = READ_LOW_DWORD(&tablePtr->fit.intercept);
+    t->index = (const PressureIndex*)READ_POINTER(&tablePtr->index);
+    if (t->index != NULL) {
+        t->indexSegments = (const uint8_t*)READ_POINTER(&t->index->segments);
+        t->firstBucket = READ_WORD(&t->index->firstBucket);
+    }
+    t->slopes = (const int32_t*)READ_POINTER(&tablePtr->slopes);
+}
+
+/* Same as the extrapolation of ConvertADCReadingToPressure(...) truncated to 32 bits: the product of the
+*  32-bit slope and the 16-bit reading, modulo 2^32, is made of two 16x16->32 products.
+*/
+static int32_t Extrapolate(const AVRTable* t, uint16_t adcReading) {
+    uint32_t low = (uint32_t)(uint16_t)t->fitSlope * adcReading;
+    uint32_t high = (uint32_t)(uint16_t)(t->fitSlope >> 16) * adcReading;
+
+    return (int32_t)(low + (high << 16) + t->fitIntercept);
+}
+
+/* Same as FindSegment(...) and LookupSegment(...) of pressure_sensor.c, over the table in program memory,
+*  checking the given segment first. The caller must ensure that minADC <= adcReading < maxADC.
+*/
+static int16_t FindSegmentAVR(const AVRTable* t, int16_t segment, uint16_t adcReading) {
+    if ((adcReading >= EntryADC(t->entries, segment)) && (adcReading < EntryADC(t->entries, segment + 1))) {
+        return segment;
+    }
+    if (t->index != NULL) {
+        segment = READ_BYTE(&t->indexSegments[(adcReading >> PRESSURE_INDEX_SHIFT) - t->firstBucket]);
+        while (adcReading >= EntryADC(t->entries, segment + 1)) {
+            segment++;
+        }
+    }
+    else {
+        int16_t searchWindowStart = 0;
+        int16_t searchWindowEnd = t->tableSize;
+
+        while ((searchWindowEnd - searchWindowStart) > 1) {
+            int16_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+            if (adcReading < EntryADC(t->entries, midPoint)) {
+                searchWindowEnd = midPoint;
+            }
+            else {
+                searchWindowStart = midPoint;
+            }
+        }
+        segment = searchWindowStart;
+    }
+    return segment;
+}
+
+/* Same as InterpolateSegment(...) of pressure_sensor.c. With the slopes, the Q16 slope is split so that
+*  P1 + ((slope * distance + 2^15) >> 16) is P1 + high * distance + ((low * distance + 2^15) >> 16),
+*  which only takes 16x16->32 multiplies. (|slope| < 2^31 fits the high half in 16 bits, since
+*  PressureSlopes_Init(...) limits the pressure steps to 15 bits.)
+*/
+static int32_t InterpolateAVR(const AVRTable* t, int16_t segment, uint16_t adcReading) {
+    const int32_t P1 = EntryPressure(t->entries, segment);
+    const uint16_t distance = adcReading - EntryADC(t->entries, segment);
+
+    if (t->slopes != NULL) {
+        const uint32_t slope = READ_DWORD(&t->slopes[segment]);
+        int32_t high = (int32_t)(int16_t)(slope >> 16) * distance;
+        uint32_t low = (uint32_t)(uint16_t)slope * distance;
+        return P1 + high + (int32_t)((low + (1UL << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+    }
+    else {
+        const int32_t P2 = EntryPressure(t->entries, segment + 1);
+        const uint16_t ADC2 = EntryADC(t->entries, segment + 1);
+        return P1 + ((P2 - P1) / (int32_t)(ADC2 - EntryADC(t->entries, segment))) * distance;
+    }
+}
+
+static int32_t ConvertAVR(const AVRTable* t, int16_t* segmentPtr, uint16_t adcReading) {
+    if ((adcReading < t->minADC) || (adcReading > t->maxADC)) {
+        return Extrapolate(t, adcReading);
+    }
+    if (adcReading == t->maxADC) {
+        return EntryPressure(t->entries, t->tableSize);
+    }
+    *segmentPtr = FindSegmentAVR(t, *segmentPtr, adcReading);
+    return InterpolateAVR(t, *segmentPtr, adcReading);
+}
+
+/* This function converts an ADC reading with a table descriptor in program memory (e.g. the generated
+*  pressureTableDescriptor on AVR), with the same result as ConvertADCReadingToPressure(...).
+*/
+int32_t ConvertADCReadingToPressureAVR(uint16_t adcReading, const PressureTable* tablePtr) {
+    AVRTable t;
+    int16_t segment = 0;
+
+    ReadTable(tablePtr, &t);
+    return ConvertAVR(&t, &segment, adcReading);
+}
+
+/* This function converts a buffer of ADC readings with a table descriptor in program memory, with the
+*  same results as ConvertADCBufferToPressure(...). The descriptor is read once for the whole buffer,
+*  and the segment of the previous reading is checked first.
+*/
+void ConvertADCBufferToPressureAVR(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    AVRTable table;
+    int16_t segment = 0;
+
+    ReadTable(t, &table);
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ConvertAVR(&table, &segment, in[i]);
+    }
+}
@@ -0,0 +1,211 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Calibration CSV
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module reads the calibration CSV of a sensor in a desktop environment, both for the table
+*   generator (tools/gen_pressure_table.c), which turns it into compile-time constants, and for the host
+*   tools that load the calibration of many sensors at run-time (see pressure_daemon.c).
+*
+*   The CSV holds one "pressure_kpa,adc" row per table entry, sorted by strictly increasing ADC reading.
+*   The pressure may have up to 2 decimals (0.01 KPa precision). Blank lines, lines starting with '#'
+*   and a header row are ignored.
+*
+***************************************************************************************************/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pressure_calibration.h"
+
+#define MAX_LINE_LENGTH 256
+
+// Descriptor loaded by PressureCalibration_Load(...), with the index it points to. The descriptor comes
+// first, so the pointer to it is also that of the allocation.
+typedef struct {
+    PressureTable table;
+    PressureIndex index;
+} PressureCalibrationTable;
+
+/* Parses a pressure in KPa with up to 2 decimals into its value scaled by FIXED_POINT_ARITH, without
+*  going through floating point so that the table holds exactly what the calibration CSV says.
+*  Returns 0 on success and -1 on a malformed value.
+*/
+static int ParsePressure(const char* text, int32_t* pressurePtr) {
+    int32_t sign = 1;
+    int32_t integerPart = 0;
+    int32_t fractionalPart = 0;
+    int fractionalDigits = 0;
+    int integerDigits = 0;
+
+    if (*text == '-') {
+        sign = -1;
+        text++;
+    }
+    while (isdigit((unsigned char)*text)) {
+        if (integerPart > (INT32_MAX / FIXED_POINT_ARITH) / 10) {
+            return -1;
+        }
+        integerPart = integerPart * 10 + (*text - '0');
+        integerDigits++;
+        text++;
+    }
+    if (*text == '.') {
+        text++;
+        while (isdigit((unsigned char)*text)) {
+            if (fractionalDigits == 2) {
+                return -1;
+            }
+            fractionalPart = fractionalPart * 10 + (*text - '0');
+            fractionalDigits++;
+            text++;
+        }
+    }
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    if ((integerDigits == 0 && fractionalDigits == 0) || (*text != '\0')) {
+        return -1;
+    }
+    for (; fractionalDigits < 2; fractionalDigits++) {
+        fractionalPart = fractionalPart * 10;
+    }
+    *pressurePtr = sign * (integerPart * FIXED_POINT_ARITH + fractionalPart);
+    return 0;
+}
+
+/* Parses a raw ADC reading. Returns 0 on success and -1 on a malformed or out-of-range value. */
+static int ParseADC(const char* text, uint16_t* adcPtr) {
+    char* end;
+    long value;
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    if (!isdigit((unsigned char)*text)) {
+        return -1;
+    }
+    value = strtol(text, &end, 10);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    if ((*end != '\0') || (value > UINT16_MAX)) {
+        return -1;
+    }
+    *adcPtr = (uint16_t)value;
+    return 0;
+}
+
+/* This function reads a calibration CSV into the table entries, which must have room for
+*  PRESSURE_CALIBRATION_MAX_ENTRIES entries. The errors are reported on stderr with the path and the line
+*  of the CSV. Returns the number of entries, or -1 on error.
+*/
+int PressureCalibration_Read(FILE* csv, const char* path, PressureTableEntry* entries) {
+    char line[MAX_LINE_LENGTH];
+    int lineNumber = 0;
+    int entryCount = 0;
+    int headerAllowed = 1;
+
+    while (fgets(line, sizeof(line), csv) != NULL) {
+        char* text = line;
+        char* separator;
+        lineNumber++;
+
+        text[strcspn(text, "\r\n")] = '\0';
+        while (isspace((unsigned char)*text)) {
+            text++;
+        }
+        if ((*text == '\0') || (*text == '#')) {
+            continue;
+        }
+        separator = strchr(text, ',');
+        if (headerAllowed && (isalpha((unsigned char)*text) || (*text == '"'))) {
+            // The first row is a header naming the columns.
+            headerAllowed = 0;
+            continue;
+        }
+        headerAllowed = 0;
+        if (separator == NULL) {
+            fprintf(stderr, "%s:%d: expected \"pressure_kpa,adc\"\n", path, lineNumber);
+            return -1;
+        }
+        *separator = '\0';
+        if (entryCount == PRESSURE_CALIBRATION_MAX_ENTRIES) {
+            fprintf(stderr, "%s:%d: more than %d table entries\n", path, lineNumber, PRESSURE_CALIBRATION_MAX_ENTRIES);
+            return -1;
+        }
+        if (ParsePressure(text, &entries[entryCount].pressure) != 0) {
+            fprintf(stderr, "%s:%d: invalid pressure \"%s\"\n", path, lineNumber, text);
+            return -1;
+        }
+        if (ParseADC(separator + 1, &entries[entryCount].adc) != 0) {
+            fprintf(stderr, "%s:%d: invalid ADC reading \"%s\"\n", path, lineNumber, separator + 1);
+            return -1;
+        }
+        if ((entryCount > 0) && (entries[entryCount].adc <= entries[entryCount - 1].adc)) {
+            fprintf(stderr, "%s:%d: ADC readings must be strictly increasing\n", path, lineNumber);
+            return -1;
+        }
+        entryCount++;
+    }
+    if (entryCount < 2) {
+        fprintf(stderr, "%s: at least 2 table entries are needed\n", path);
+        return -1;
+    }
+    return entryCount;
+}
+
+/* This function loads a calibration CSV into a table descriptor built in RAM, with the extrapolation
+*  fit, and the direct segment index and the segment slopes when the table can use them, like the
+*  descriptor the table generator emits. The descriptor and all of its data are a single allocation,
+*  released with free(). Returns NULL on error, which is reported on stderr.
+*/
+PressureTable* PressureCalibration_Load(const char* path) {
+    static PressureTableEntry entries[PRESSURE_CALIBRATION_MAX_ENTRIES];
+    static uint8_t indexSegments[PRESSURE_INDEX_BUCKETS(0, UINT16_MAX)];
+    PressureIndex index;
+    PressureCalibrationTable* calibrationPtr;
+    PressureTableEntry* tableEntries;
+    int32_t* slopes;
+    uint8_t* segments;
+    int16_t tableSize;
+    int entryCount;
+    int hasIndex;
+    FILE* csv = fopen(path, "r");
+
+    if (csv == NULL) {
+        fprintf(stderr, "%s: cannot open calibration CSV\n", path);
+        return NULL;
+    }
+    entryCount = PressureCalibration_Read(csv, path, entries);
+    fclose(csv);
+    if (entryCount < 0) {
+        return NULL;
+    }
+    tableSize = (int16_t)(entryCount - 1);
+    hasIndex = (PressureIndex_Init(&index, indexSegments, entries, tableSize) >= 0);
+
+    // The entries, the slopes and the index segments follow the descriptor, in decreasing alignment.
+    calibrationPtr = malloc(sizeof(*calibrationPtr) + entryCount * (sizeof(PressureTableEntry) + sizeof(int32_t))
+                            + (hasIndex ? index.bucketCount : 0));
+    if (calibrationPtr == NULL) {
+        fprintf(stderr, "%s: cannot allocate the table\n", path);
+        return NULL;
+    }
+    tableEntries = (PressureTableEntry*)(calibrationPtr + 1);
+    slopes = (int32_t*)(tableEntries + entryCount);
+    segments = (uint8_t*)(slopes + entryCount);
+
+    memcpy(tableEntries, entries, entryCount * sizeof(PressureTableEntry));
+    if (hasIndex) {
+        memcpy(segments, indexSegments, index.bucketCount);
+        index.segments = segments;
+        calibrationPtr->index = index;
+    }
+    PressureTable_Init(&calibrationPtr->table, tableEntries, tableSize, hasIndex ? &calibrationPtr->index : NULL,
+                       (PressureSlopes_Init(slopes, tableEntries, tableSize) == 0) ? slopes : NULL);
+    return &calibrationPtr->table;
+}
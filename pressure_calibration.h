@@ -0,0 +1,25 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Calibration CSV
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Reading of calibration CSVs in a desktop environment (see pressure_calibration.c).
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_CALIBRATION_H
+#define PRESSURE_CALIBRATION_H
+
+#include <stdio.h>
+
+#include "pressure_sensor.h"
+
+// Maximum number of entries accepted in a calibration CSV.
+#define PRESSURE_CALIBRATION_MAX_ENTRIES 4096
+
+int PressureCalibration_Read(FILE* csv, const char* path, PressureTableEntry* entries);
+PressureTable* PressureCalibration_Load(const char* path);
+
+#endif // PRESSURE_CALIBRATION_H
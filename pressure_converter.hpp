@@ -0,0 +1,234 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Compile-Time Converter (C++17)
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This header-only module provides PressureConverter<Table>, a C++17 converter specialized at compile
+*   time for one Pressure-ADC table. The table is given as a type with a constexpr entries[] array, and
+*   everything that pressure_table_build.c precomputes for the C descriptor (extrapolation fit, direct
+*   segment index and segment slopes) is computed from it by constexpr functions instead, with the same
+*   integer arithmetic. The compiler can then inline the whole conversion with every table access folded
+*   to a constant address, and a small table is searched with a fully unrolled compare-and-count.
+*
+*   The results are bit-identical to ConvertADCReadingToPressure(...) with the descriptor the table
+*   generator emits for the same table, which remains the ABI-stable entry point for C code.
+*
+*   The generated entries are made available at compile time through their X-macro list, e.g.
+*     struct SensorTable {
+*         static constexpr PressureTableEntry entries[] = { PRESSURE_TABLE_ENTRIES(PRESSURE_TABLE_ENTRY) };
+*     };
+*     int32_t pressure = pressure::PressureConverter<SensorTable>::Convert(adcReading);
+*   pressure::PressureTableConverter is the converter of the default table, pressureTable.
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_CONVERTER_HPP
+#define PRESSURE_CONVERTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "pressure_sensor.h"
+#include "pressure_table.h"
+
+namespace pressure {
+
+namespace detail {
+
+template <typename Table>
+constexpr int16_t TableSize() noexcept {
+    return static_cast<int16_t>(std::size(Table::entries) - 1);
+}
+
+/* Same as PressureFit_Init(...), including its "sum / N - 1" averages. */
+template <typename Table>
+constexpr PressureFit ComputeFit() noexcept {
+    constexpr int16_t tableSize = TableSize<Table>();
+    int64_t sumOfADC_iTimesP_i = 0;
+    int64_t sumOfADC_i = 0;
+    int64_t sumOfP_i = 0;
+    int64_t sumOfADC_iSquared = 0;
+    PressureFit fit = {};
+
+    for (int16_t i = 0; i <= tableSize; i++) {
+        sumOfADC_iTimesP_i = sumOfADC_iTimesP_i + static_cast<int64_t>(Table::entries[i].adc) * (Table::entries[i].pressure / FIXED_POINT_ARITH);
+        sumOfADC_i = sumOfADC_i + Table::entries[i].adc;
+        sumOfP_i = sumOfP_i + Table::entries[i].pressure / FIXED_POINT_ARITH;
+        sumOfADC_iSquared = sumOfADC_iSquared + static_cast<int64_t>(Table::entries[i].adc) * Table::entries[i].adc;
+    }
+    sumOfADC_iTimesP_i = sumOfADC_iTimesP_i / (tableSize + 1) - 1;
+    sumOfADC_i = sumOfADC_i / (tableSize + 1) - 1;
+    sumOfP_i = sumOfP_i / (tableSize + 1) - 1;
+    sumOfADC_iSquared = sumOfADC_iSquared / (tableSize + 1) - 1;
+    fit.slope = (sumOfADC_iTimesP_i - sumOfADC_i * sumOfP_i) * FIXED_POINT_ARITH / (sumOfADC_iSquared - sumOfADC_i * sumOfADC_i);
+    fit.intercept = (sumOfADC_iSquared * sumOfP_i - sumOfADC_i * sumOfADC_iTimesP_i) * FIXED_POINT_ARITH / (sumOfADC_iSquared - sumOfADC_i * sumOfADC_i);
+    return fit;
+}
+
+/* Same condition as PressureSlopes_Init(...): every pressure step must fit in 15 bits. */
+template <typename Table>
+constexpr bool HasSlopes() noexcept {
+    for (int16_t segment = 0; segment < TableSize<Table>(); segment++) {
+        int32_t pressureStep = Table::entries[segment + 1].pressure - Table::entries[segment].pressure;
+        if ((pressureStep >= (1L << 15)) || (pressureStep <= -(1L << 15))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Same as PressureSlopes_Init(...), for a table with HasSlopes<Table>(). */
+template <typename Table>
+constexpr std::array<int32_t, std::size(Table::entries) - 1> ComputeSlopes() noexcept {
+    std::array<int32_t, std::size(Table::entries) - 1> slopes = {};
+
+    for (int16_t segment = 0; segment < TableSize<Table>(); segment++) {
+        int32_t pressureStep = Table::entries[segment + 1].pressure - Table::entries[segment].pressure;
+        int32_t adcStep = Table::entries[segment + 1].adc - Table::entries[segment].adc;
+        int32_t scaledStep = pressureStep * (1L << PRESSURE_SLOPE_SHIFT);
+        slopes[segment] = (scaledStep + ((scaledStep < 0) ? -(adcStep / 2) : (adcStep / 2))) / adcStep;
+    }
+    return slopes;
+}
+
+/* Same condition as PressureIndex_Init(...): the segments must fit in 8 bits. */
+template <typename Table>
+constexpr bool HasIndex() noexcept {
+    return TableSize<Table>() <= UINT8_MAX;
+}
+
+template <typename Table>
+constexpr uint16_t IndexBuckets() noexcept {
+    return PRESSURE_INDEX_BUCKETS(Table::entries[0].adc, Table::entries[TableSize<Table>()].adc);
+}
+
+/* Same as PressureIndex_Init(...), for a table with HasIndex<Table>(). */
+template <typename Table>
+constexpr std::array<uint8_t, IndexBuckets<Table>()> ComputeIndex() noexcept {
+    constexpr int16_t tableSize = TableSize<Table>();
+    constexpr uint16_t firstBucket = Table::entries[0].adc >> PRESSURE_INDEX_SHIFT;
+    std::array<uint8_t, IndexBuckets<Table>()> segments = {};
+    int16_t segment = 0;
+
+    for (uint16_t bucket = 0; bucket < IndexBuckets<Table>(); bucket++) {
+        uint16_t bucketStart = static_cast<uint16_t>((firstBucket + bucket) << PRESSURE_INDEX_SHIFT);
+
+        if (bucketStart < Table::entries[0].adc) {
+            bucketStart = Table::entries[0].adc;
+        }
+        while ((segment < (tableSize - 1)) && (bucketStart >= Table::entries[segment + 1].adc)) {
+            segment++;
+        }
+        segments[bucket] = static_cast<uint8_t>(segment);
+    }
+    return segments;
+}
+
+} // namespace detail
+
+template <typename Table>
+class PressureConverter {
+public:
+    // Index of the last entry in the table (i.e. the number of entries minus one), as for the C functions.
+    static constexpr int16_t tableSize = detail::TableSize<Table>();
+    static constexpr PressureFit fit = detail::ComputeFit<Table>();
+
+    static_assert((std::size(Table::entries) >= 2) && (std::size(Table::entries) <= INT16_MAX), "a Pressure-ADC table needs 2 to 32767 entries");
+
+    /* Converts one ADC reading, with the same result as ConvertADCReadingToPressure(...). */
+    static constexpr int Convert(int adcReading) noexcept {
+        if ((adcReading >= minADC) && (adcReading <= maxADC)) {
+            if (adcReading == maxADC) {
+                return Table::entries[tableSize].pressure;
+            }
+            return Interpolate(FindSegment(static_cast<uint16_t>(adcReading)), static_cast<uint16_t>(adcReading));
+        }
+        // The extrapolation is truncated to 32 bits, as by the C function.
+        return static_cast<int32_t>(fit.slope * adcReading + fit.intercept);
+    }
+
+    /* Converts a buffer of ADC readings, with the same results as ConvertADCBufferToPressure(...). */
+    static void Convert(const uint16_t* in, int32_t* out, std::size_t n) noexcept {
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = Convert(in[i]);
+        }
+    }
+
+private:
+    static constexpr uint16_t minADC = Table::entries[0].adc;
+    static constexpr uint16_t maxADC = Table::entries[tableSize].adc;
+    // Largest table searched with a fully unrolled compare-and-count instead of the index.
+    static constexpr int16_t maxUnrolledTableSize = 16;
+    static constexpr bool hasSlopes = detail::HasSlopes<Table>();
+    static constexpr bool hasIndex = detail::HasIndex<Table>();
+    static constexpr std::array<int32_t, std::size(Table::entries) - 1> slopes = detail::ComputeSlopes<Table>();
+    static constexpr std::array<uint8_t, detail::IndexBuckets<Table>()> indexSegments = detail::ComputeIndex<Table>();
+
+    /* Finds the segment [entries[segment].adc, entries[segment + 1].adc) that contains the ADC reading,
+    *  for minADC <= adcReading < maxADC. All three searches give the same segment.
+    */
+    static constexpr int16_t FindSegment(uint16_t adcReading) noexcept {
+        if constexpr (tableSize <= maxUnrolledTableSize) {
+            // The segment is the number of inner entries at or below the reading.
+            int16_t segment = 0;
+            for (int16_t i = 1; i < tableSize; i++) {
+                segment += (adcReading >= Table::entries[i].adc);
+            }
+            return segment;
+        }
+        else if constexpr (hasIndex) {
+            int16_t segment = indexSegments[(adcReading >> PRESSURE_INDEX_SHIFT) - (minADC >> PRESSURE_INDEX_SHIFT)];
+            while (adcReading >= Table::entries[segment + 1].adc) {
+                segment++;
+            }
+            return segment;
+        }
+        else {
+            int16_t searchWindowStart = 0;
+            int16_t searchWindowEnd = tableSize;
+            while ((searchWindowEnd - searchWindowStart) > 1) {
+                int16_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+                if (adcReading < Table::entries[midPoint].adc) {
+                    searchWindowEnd = midPoint;
+                }
+                else {
+                    searchWindowStart = midPoint;
+                }
+            }
+            return searchWindowStart;
+        }
+    }
+
+    /* Same as the interpolation of the C functions: with the Q16 slopes when the table generator would
+    *  emit them, and with the original division otherwise.
+    */
+    static constexpr int32_t Interpolate(int16_t segment, uint16_t adcReading) noexcept {
+        int32_t P1 = Table::entries[segment].pressure;
+        uint16_t ADC1 = Table::entries[segment].adc;
+
+        if constexpr (hasSlopes) {
+            int32_t offset = slopes[segment] * static_cast<int32_t>(adcReading - ADC1);
+            return static_cast<int32_t>(P1 + ((offset + (1L << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT));
+        }
+        else {
+            int32_t P2 = Table::entries[segment + 1].pressure;
+            uint16_t ADC2 = Table::entries[segment + 1].adc;
+            return P1 + ((P2 - P1) / (ADC2 - ADC1)) * (adcReading - ADC1);
+        }
+    }
+};
+
+// Compile-time form of the default table, pressureTable.
+struct PressureTableData {
+    static constexpr PressureTableEntry entries[] = { PRESSURE_TABLE_ENTRIES(PRESSURE_TABLE_ENTRY) };
+};
+
+using PressureTableConverter = PressureConverter<PressureTableData>;
+
+} // namespace pressure
+
+#endif // PRESSURE_CONVERTER_HPP
@@ -0,0 +1,443 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Multi-Sensor Daemon
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts the raw ADC frames that many sensor nodes stream to a Linux gateway, over UDP
+*   and over serial ports, in a single event loop instead of one process per stream. All of the sources
+*   are non-blocking and multiplexed with epoll:
+*     1. Every UDP datagram holds one or more whole frames. The bytes of a serial port (or of a pipe or
+*        FIFO) are reassembled into frames in the buffer of the stream, and the magic of the frames is
+*        used to find the next frame after a corrupted one.
+*     2. Every frame is converted with the batch conversion function and the table of its sensor, found
+*        by its ID in the sorted list of sensors, or the default table for the other sensors.
+*     3. The converted frames are batched in the output buffer, which is written once per wake-up of
+*        the event loop (or when it is full) rather than once per frame.
+*
+*   The input frames are, in little-endian:
+*     uint16 PRESSURE_DAEMON_FRAME_MAGIC, uint16 sensor ID, uint16 sample count (1 to
+*     PRESSURE_DAEMON_MAX_FRAME_SAMPLES), then that many uint16 ADC samples.
+*   The output frames have the same header, followed by the int32 pressures in 0.01 KPa.
+*
+*   io_uring would save the readiness notifications, but the reads are already batched per wake-up, and
+*   epoll needs no library beyond libc, so only epoll is implemented.
+*
+***************************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pressure_daemon.h"
+#include "pressure_simd.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#define PRESSURE_DAEMON_HAS_EPOLL 1
+#endif
+
+/* This function initializes the daemon, with no sensors nor sources. The converted frames are written
+*  to outputFd, and the frames of the sensors that are not added with PressureDaemon_AddSensor(...) are
+*  converted with defaultTablePtr, or dropped if it is NULL.
+*/
+void PressureDaemon_Init(PressureDaemon* daemonPtr, int outputFd, const PressureTable* defaultTablePtr) {
+    daemonPtr->sensorCount = 0;
+    daemonPtr->defaultTable = defaultTablePtr;
+    daemonPtr->sourceCount = 0;
+    daemonPtr->outputFd = outputFd;
+    daemonPtr->stopRequested = 0;
+    daemonPtr->frames = 0;
+    daemonPtr->samples = 0;
+    daemonPtr->droppedFrames = 0;
+    daemonPtr->skippedBytes = 0;
+    daemonPtr->batches = 0;
+    daemonPtr->outputLength = 0;
+}
+
+/* This function sets the table of a sensor, replacing its previous table if it already has one. The
+*  sensors are kept sorted by ID, so the table of a frame is found with a binary search.
+*  Returns -1 if there are already PRESSURE_DAEMON_MAX_SENSORS sensors, and 0 otherwise.
+*/
+int PressureDaemon_AddSensor(PressureDaemon* daemonPtr, uint16_t id, const PressureTable* tablePtr) {
+    uint16_t i = daemonPtr->sensorCount;
+
+    for (uint16_t j = 0; j < daemonPtr->sensorCount; j++) {
+        if (daemonPtr->sensors[j].id == id) {
+            daemonPtr->sensors[j].table = tablePtr;
+            return 0;
+        }
+    }
+    if (daemonPtr->sensorCount == PRESSURE_DAEMON_MAX_SENSORS) {
+        return -1;
+    }
+    while ((i > 0) && (daemonPtr->sensors[i - 1].id > id)) {
+        daemonPtr->sensors[i] = daemonPtr->sensors[i - 1];
+        i--;
+    }
+    daemonPtr->sensors[i].id = id;
+    daemonPtr->sensors[i].table = tablePtr;
+    daemonPtr->sensorCount++;
+    return 0;
+}
+
+/* This function makes the next call to PressureDaemon_Run(...) return, once the current wake-up of the
+*  event loop is done. It is safe to call from the handler of SIGINT or SIGTERM.
+*/
+void PressureDaemon_Stop(PressureDaemon* daemonPtr) {
+    daemonPtr->stopRequested = 1;
+}
+
+#if defined(PRESSURE_DAEMON_HAS_EPOLL)
+static uint16_t ReadUInt16(const uint8_t* bytes) {
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static void WriteUInt16(uint8_t* bytes, uint16_t value) {
+    bytes[0] = (uint8_t)value;
+    bytes[1] = (uint8_t)(value >> 8);
+}
+
+/* Returns the table of the sensor, or the default table if the sensor was not added. */
+static const PressureTable* FindSensorTable(const PressureDaemon* daemonPtr, uint16_t id) {
+    int32_t searchWindowStart = 0;
+    int32_t searchWindowEnd = (int32_t)daemonPtr->sensorCount - 1;
+
+    while (searchWindowStart <= searchWindowEnd) {
+        int32_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+        if (daemonPtr->sensors[midPoint].id == id) {
+            return daemonPtr->sensors[midPoint].table;
+        }
+        if (daemonPtr->sensors[midPoint].id < id) {
+            searchWindowStart = midPoint + 1;
+        }
+        else {
+            searchWindowEnd = midPoint - 1;
+        }
+    }
+    return daemonPtr->defaultTable;
+}
+
+/* Writes the batched output frames. Returns 0 on success and -1 on a write error. */
+static int FlushOutput(PressureDaemon* daemonPtr) {
+    size_t written = 0;
+
+    while (written < daemonPtr->outputLength) {
+        ssize_t result = write(daemonPtr->outputFd, &daemonPtr->output[written], daemonPtr->outputLength - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error occured while writing the pressure frames.\n");
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    if (daemonPtr->outputLength > 0) {
+        daemonPtr->batches++;
+    }
+    daemonPtr->outputLength = 0;
+    return 0;
+}
+
+/* Converts the samples of a frame and appends the output frame to the batch. Returns 0 on success and
+*  -1 on a write error.
+*/
+static int ConvertFrame(PressureDaemon* daemonPtr, uint16_t id, const PressureTable* tablePtr, const uint8_t* samples, uint16_t sampleCount) {
+    size_t frameBytes = PRESSURE_DAEMON_HEADER_BYTES + sampleCount * sizeof(int32_t);
+    uint8_t* out;
+
+    for (uint16_t i = 0; i < sampleCount; i++) {
+        daemonPtr->adc[i] = ReadUInt16(&samples[2 * i]);
+    }
+    ConvertADCBufferToPressureVector(daemonPtr->adc, daemonPtr->pressures, sampleCount, tablePtr);
+
+    if (((daemonPtr->outputLength + frameBytes) > PRESSURE_DAEMON_OUTPUT_BYTES) && (FlushOutput(daemonPtr) != 0)) {
+        return -1;
+    }
+    out = &daemonPtr->output[daemonPtr->outputLength];
+    WriteUInt16(&out[0], PRESSURE_DAEMON_FRAME_MAGIC);
+    WriteUInt16(&out[2], id);
+    WriteUInt16(&out[4], sampleCount);
+    out += PRESSURE_DAEMON_HEADER_BYTES;
+    for (uint16_t i = 0; i < sampleCount; i++) {
+        // Serialized byte by byte so that the output is little-endian on any host.
+        uint32_t pressure = (uint32_t)daemonPtr->pressures[i];
+        out[4 * i] = (uint8_t)pressure;
+        out[4 * i + 1] = (uint8_t)(pressure >> 8);
+        out[4 * i + 2] = (uint8_t)(pressure >> 16);
+        out[4 * i + 3] = (uint8_t)(pressure >> 24);
+    }
+    daemonPtr->outputLength += frameBytes;
+    daemonPtr->frames++;
+    daemonPtr->samples += sampleCount;
+    return 0;
+}
+
+/* Converts the whole frames at the start of the bytes, and sets *consumedPtr to the number of bytes
+*  used. A datagram must only hold whole frames, so anything left after a malformed header or frame
+*  is dropped. In a stream, a malformed header is skipped byte by byte until the next magic, and an
+*  incomplete frame is left for the next read. Returns 0 on success and -1 on a write error.
+*/
+static int ConvertFrames(PressureDaemon* daemonPtr, const uint8_t* bytes, size_t length, int isDatagram, size_t* consumedPtr) {
+    size_t position = 0;
+
+    while ((length - position) >= PRESSURE_DAEMON_HEADER_BYTES) {
+        const uint8_t* header = &bytes[position];
+        uint16_t sampleCount = ReadUInt16(&header[4]);
+        size_t frameBytes = PRESSURE_DAEMON_HEADER_BYTES + sampleCount * sizeof(uint16_t);
+        const PressureTable* tablePtr;
+
+        if ((ReadUInt16(&header[0]) != PRESSURE_DAEMON_FRAME_MAGIC) || (sampleCount == 0) || (sampleCount > PRESSURE_DAEMON_MAX_FRAME_SAMPLES)) {
+            if (isDatagram) {
+                daemonPtr->droppedFrames++;
+                position = length;
+                break;
+            }
+            daemonPtr->skippedBytes++;
+            position++;
+            continue;
+        }
+        if ((length - position) < frameBytes) {
+            if (isDatagram) {
+                daemonPtr->droppedFrames++;
+                position = length;
+            }
+            break;
+        }
+        tablePtr = FindSensorTable(daemonPtr, ReadUInt16(&header[2]));
+        if (tablePtr == NULL) {
+            daemonPtr->droppedFrames++;
+        }
+        else if (ConvertFrame(daemonPtr, ReadUInt16(&header[2]), tablePtr, &header[PRESSURE_DAEMON_HEADER_BYTES], sampleCount) != 0) {
+            return -1;
+        }
+        position += frameBytes;
+    }
+    if (isDatagram && (position < length)) {
+        // A datagram ending with fewer bytes than a header.
+        daemonPtr->droppedFrames++;
+        position = length;
+    }
+    *consumedPtr = position;
+    return 0;
+}
+
+static int AddSource(PressureDaemon* daemonPtr, int fd, int isDatagram) {
+    PressureDaemonSource* sourcePtr;
+
+    if (daemonPtr->sourceCount == PRESSURE_DAEMON_MAX_SOURCES) {
+        fprintf(stderr, "At most %d UDP ports and serial streams can be converted.\n", PRESSURE_DAEMON_MAX_SOURCES);
+        return -1;
+    }
+    sourcePtr = &daemonPtr->sources[daemonPtr->sourceCount++];
+    sourcePtr->fd = fd;
+    sourcePtr->isDatagram = isDatagram;
+    sourcePtr->length = 0;
+    return 0;
+}
+
+/* Reads every datagram waiting on the UDP socket. Returns 0 on success and -1 on error. */
+static int ReadDatagrams(PressureDaemon* daemonPtr, PressureDaemonSource* sourcePtr) {
+    for (;;) {
+        // With MSG_TRUNC, the length of a datagram larger than the buffer is returned.
+        ssize_t length = recv(sourcePtr->fd, sourcePtr->buffer, sizeof(sourcePtr->buffer), MSG_TRUNC);
+        size_t consumed;
+
+        if (length < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                return 0;
+            }
+            fprintf(stderr, "Error occured while receiving a UDP datagram.\n");
+            return -1;
+        }
+        if ((size_t)length > sizeof(sourcePtr->buffer)) {
+            daemonPtr->droppedFrames++;
+        }
+        else if (ConvertFrames(daemonPtr, sourcePtr->buffer, (size_t)length, 1, &consumed) != 0) {
+            return -1;
+        }
+    }
+}
+
+/* Reads the bytes waiting on the stream. Returns 1 at the end of the stream, 0 if it remains open, and
+*  -1 on a write error.
+*/
+static int ReadStream(PressureDaemon* daemonPtr, PressureDaemonSource* sourcePtr) {
+    for (;;) {
+        ssize_t length = read(sourcePtr->fd, &sourcePtr->buffer[sourcePtr->length], sizeof(sourcePtr->buffer) - sourcePtr->length);
+        size_t consumed;
+
+        if (length < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                return 0;
+            }
+            fprintf(stderr, "Error occured while reading a serial stream.\n");
+        }
+        if (length <= 0) {
+            if (sourcePtr->length > 0) {
+                // The stream ended within a frame.
+                daemonPtr->droppedFrames++;
+            }
+            return 1;
+        }
+        sourcePtr->length += (size_t)length;
+        if (ConvertFrames(daemonPtr, sourcePtr->buffer, sourcePtr->length, 0, &consumed) != 0) {
+            return -1;
+        }
+        // The buffer holds a whole frame of the largest size, so a full buffer always holds a frame to consume.
+        memmove(sourcePtr->buffer, &sourcePtr->buffer[consumed], sourcePtr->length - consumed);
+        sourcePtr->length -= consumed;
+    }
+}
+#endif
+
+/* This function opens a UDP socket on the given port, on every IPv4 interface, and adds it to the
+*  sources of the daemon. Returns 0 on success and -1 on error.
+*/
+int PressureDaemon_AddUDP(PressureDaemon* daemonPtr, uint16_t port) {
+#if defined(PRESSURE_DAEMON_HAS_EPOLL)
+    struct sockaddr_in address;
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create a UDP socket.\n");
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Cannot bind UDP port %u.\n", port);
+        close(fd);
+        return -1;
+    }
+    if (AddSource(daemonPtr, fd, 1) != 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+#else
+    (void)daemonPtr;
+    (void)port;
+    fprintf(stderr, "The multi-sensor daemon requires Linux epoll.\n");
+    return -1;
+#endif
+}
+
+/* This function opens a byte stream, e.g. a serial port, a pipe or a FIFO ("-" for stdin), and adds it
+*  to the sources of the daemon, which closes it at its end. A serial port is switched to raw mode, with
+*  its speed left as configured (e.g. with stty). Returns 0 on success and -1 on error.
+*/
+int PressureDaemon_AddStream(PressureDaemon* daemonPtr, const char* path) {
+#if defined(PRESSURE_DAEMON_HAS_EPOLL)
+    int fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    int flags;
+
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot open the serial stream.\n", path);
+        return -1;
+    }
+    if (isatty(fd)) {
+        struct termios settings;
+        if (tcgetattr(fd, &settings) == 0) {
+            cfmakeraw(&settings);
+            tcsetattr(fd, TCSANOW, &settings);
+        }
+    }
+    flags = fcntl(fd, F_GETFL);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) || (AddSource(daemonPtr, fd, 0) != 0)) {
+        fprintf(stderr, "%s: cannot read the serial stream.\n", path);
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+        return -1;
+    }
+    return 0;
+#else
+    (void)daemonPtr;
+    (void)path;
+    fprintf(stderr, "The multi-sensor daemon requires Linux epoll.\n");
+    return -1;
+#endif
+}
+
+/* This function runs the event loop of the daemon, converting the frames of all of its sources, until
+*  every stream has ended (with no UDP socket) or PressureDaemon_Stop(...) is called. SIGINT and SIGTERM
+*  are only delivered while the loop waits for its sources, so a stop requested from their handler is
+*  never missed. Returns 0 when stopped or done, and -1 on error.
+*/
+int PressureDaemon_Run(PressureDaemon* daemonPtr) {
+#if defined(PRESSURE_DAEMON_HAS_EPOLL)
+    struct epoll_event events[PRESSURE_DAEMON_MAX_SOURCES];
+    sigset_t stopSignals;
+    sigset_t waitMask;
+    uint16_t openSources = daemonPtr->sourceCount;
+    int result = 0;
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epollFd < 0) {
+        fprintf(stderr, "Cannot create the event loop.\n");
+        return -1;
+    }
+    for (uint16_t i = 0; i < daemonPtr->sourceCount; i++) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, daemonPtr->sources[i].fd, &event) != 0) {
+            fprintf(stderr, "Cannot wait for a source, e.g. a regular file.\n");
+            close(epollFd);
+            return -1;
+        }
+    }
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, &waitMask);
+
+    while ((result == 0) && !daemonPtr->stopRequested && (openSources > 0)) {
+        int eventCount = epoll_pwait(epollFd, events, PRESSURE_DAEMON_MAX_SOURCES, -1, &waitMask);
+        if (eventCount < 0) {
+            if (errno != EINTR) {
+                fprintf(stderr, "Error occured while waiting for the sources.\n");
+                result = -1;
+            }
+            continue;
+        }
+        for (int e = 0; (e < eventCount) && (result == 0); e++) {
+            PressureDaemonSource* sourcePtr = &daemonPtr->sources[events[e].data.u32];
+            if (sourcePtr->isDatagram) {
+                result = ReadDatagrams(daemonPtr, sourcePtr);
+            }
+            else {
+                int streamResult = ReadStream(daemonPtr, sourcePtr);
+                if (streamResult == 1) {
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, sourcePtr->fd, NULL);
+                    close(sourcePtr->fd);
+                    sourcePtr->fd = -1;
+                    openSources--;
+                }
+                result = (streamResult < 0) ? -1 : 0;
+            }
+        }
+        // All of the frames of the wake-up are published in one batch.
+        if ((result == 0) && (FlushOutput(daemonPtr) != 0)) {
+            result = -1;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &waitMask, NULL);
+    close(epollFd);
+    return result;
+#else
+    (void)daemonPtr;
+    fprintf(stderr, "The multi-sensor daemon requires Linux epoll.\n");
+    return -1;
+#endif
+}
@@ -0,0 +1,75 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Multi-Sensor Daemon
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Event-driven conversion of the ADC frames of many sensors on a Linux gateway (see pressure_daemon.c).
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_DAEMON_H
+#define PRESSURE_DAEMON_H
+
+#include <signal.h>
+
+#include "pressure_sensor.h"
+
+// Largest number of sensors with their own table, and of UDP sockets and serial streams.
+#define PRESSURE_DAEMON_MAX_SENSORS 256
+#define PRESSURE_DAEMON_MAX_SOURCES 64
+// Frames start with the magic, the sensor ID and the number of samples, as little-endian uint16.
+#define PRESSURE_DAEMON_FRAME_MAGIC 0x5046
+#define PRESSURE_DAEMON_HEADER_BYTES 6
+// Largest number of samples of a frame, so that a frame of ADC samples fits in a UDP datagram.
+#define PRESSURE_DAEMON_MAX_FRAME_SAMPLES 8192
+#define PRESSURE_DAEMON_MAX_FRAME_BYTES (PRESSURE_DAEMON_HEADER_BYTES + PRESSURE_DAEMON_MAX_FRAME_SAMPLES * sizeof(uint16_t))
+// Size of the output buffer, in which the converted frames are batched.
+#define PRESSURE_DAEMON_OUTPUT_BYTES (256 * 1024)
+
+typedef struct {
+    uint16_t id;
+    const PressureTable* table;
+} PressureDaemonSensor;
+
+typedef struct {
+    int fd;
+    // 1 for a UDP socket, which receives whole frames in datagrams, and 0 for a byte stream (serial port,
+    // pipe or FIFO), whose frames are reassembled in the buffer.
+    int isDatagram;
+    size_t length;
+    uint8_t buffer[PRESSURE_DAEMON_MAX_FRAME_BYTES];
+} PressureDaemonSource;
+
+typedef struct {
+    // Sensors sorted by ID, and the table of the sensors not in the list (NULL to drop their frames).
+    PressureDaemonSensor sensors[PRESSURE_DAEMON_MAX_SENSORS];
+    uint16_t sensorCount;
+    const PressureTable* defaultTable;
+    PressureDaemonSource sources[PRESSURE_DAEMON_MAX_SOURCES];
+    uint16_t sourceCount;
+    // Descriptor the converted frames are written to.
+    int outputFd;
+    volatile sig_atomic_t stopRequested;
+    // Number of frames converted, of samples converted, of frames dropped (malformed, or of a sensor
+    // without a table), of bytes skipped to find the next frame of a stream, and of batches written.
+    uint64_t frames;
+    uint64_t samples;
+    uint64_t droppedFrames;
+    uint64_t skippedBytes;
+    uint64_t batches;
+    size_t outputLength;
+    uint8_t output[PRESSURE_DAEMON_OUTPUT_BYTES];
+    uint16_t adc[PRESSURE_DAEMON_MAX_FRAME_SAMPLES];
+    int32_t pressures[PRESSURE_DAEMON_MAX_FRAME_SAMPLES];
+} PressureDaemon;
+
+void PressureDaemon_Init(PressureDaemon* daemonPtr, int outputFd, const PressureTable* defaultTablePtr);
+int PressureDaemon_AddSensor(PressureDaemon* daemonPtr, uint16_t id, const PressureTable* tablePtr);
+int PressureDaemon_AddUDP(PressureDaemon* daemonPtr, uint16_t port);
+int PressureDaemon_AddStream(PressureDaemon* daemonPtr, const char* path);
+int PressureDaemon_Run(PressureDaemon* daemonPtr);
+void PressureDaemon_Stop(PressureDaemon* daemonPtr);
+
+#endif // PRESSURE_DAEMON_H
@@ -0,0 +1,113 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Paged LUT Cache
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts ADC readings through a lazily filled form of the dense table of a descriptor
+*   (see PressureTable_InitLUT(...)), for sensors that only ever span a narrow band of ADC readings. The
+*   dense table is split into pages of PRESSURE_LUT_PAGE_SIZE readings, and a page is only filled, by
+*   converting its readings as one buffer with ConvertADCBufferToPressure(...), the first time a reading
+*   lands in it. Later readings of the page are a single load, as with the dense table, with the same
+*   results. The memory used is then proportional to the band actually used, and so is the cold-start
+*   cost.
+*
+*   The pages are taken from a pool provided by the caller. Once it is exhausted, the readings of the
+*   pages not yet filled are converted without the cache. The counters of the cache (page fills, hits
+*   and readings converted without the cache) tell how large the pool needs to be.
+*
+*   A cache is not thread-safe: every thread needs its own cache, or the accesses must be serialized.
+*
+***************************************************************************************************/
+
+#include <string.h>
+
+#include "pressure_lut_cache.h"
+
+/* This function sets up an empty cache for the given descriptor, with a pool of poolPages pages
+*  (poolPages * PRESSURE_LUT_PAGE_SIZE values) to fill. At most PRESSURE_LUT_PAGE_COUNT pages are
+*  ever used, which covers every ADC reading.
+*/
+void PressureLUTCache_Init(PressureLUTCache* cachePtr, const PressureTable* tablePtr, int32_t* pool, uint16_t poolPages) {
+    cachePtr->table = tablePtr;
+    cachePtr->pool = pool;
+    cachePtr->poolPages = (poolPages > PRESSURE_LUT_PAGE_COUNT) ? PRESSURE_LUT_PAGE_COUNT : poolPages;
+    PressureLUTCache_Reset(cachePtr);
+}
+
+/* This function empties the cache and clears its counters, e.g. after the table of the descriptor has
+*  been recalibrated.
+*/
+void PressureLUTCache_Reset(PressureLUTCache* cachePtr) {
+    memset(cachePtr->pages, 0, sizeof(cachePtr->pages));
+    cachePtr->usedPages = 0;
+    cachePtr->pageFills = 0;
+    cachePtr->hits = 0;
+    cachePtr->uncached = 0;
+}
+
+/* Fills the page of the given ADC reading from the pool, and returns it, or NULL if the pool is full. */
+static int32_t* FillPage(PressureLUTCache* cachePtr, uint16_t adcReading) {
+    uint16_t readings[PRESSURE_LUT_PAGE_SIZE];
+    const uint16_t firstReading = (uint16_t)(adcReading & ~(PRESSURE_LUT_PAGE_SIZE - 1));
+    int32_t* page;
+
+    if (cachePtr->usedPages == cachePtr->poolPages) {
+        return NULL;
+    }
+    page = &cachePtr->pool[(size_t)cachePtr->usedPages * PRESSURE_LUT_PAGE_SIZE];
+    for (uint16_t i = 0; i < PRESSURE_LUT_PAGE_SIZE; i++) {
+        readings[i] = (uint16_t)(firstReading + i);
+    }
+    ConvertADCBufferToPressure(readings, page, PRESSURE_LUT_PAGE_SIZE, cachePtr->table);
+    cachePtr->pages[adcReading >> PRESSURE_LUT_PAGE_SHIFT] = page;
+    cachePtr->usedPages++;
+    cachePtr->pageFills++;
+    return page;
+}
+
+/* Converts a reading whose page is not filled yet, filling it if the pool allows. */
+static int32_t ConvertMiss(PressureLUTCache* cachePtr, uint16_t adcReading) {
+    int32_t* page = FillPage(cachePtr, adcReading);
+
+    if (page == NULL) {
+        cachePtr->uncached++;
+        return ConvertADCReadingToPressure(adcReading, cachePtr->table);
+    }
+    return page[adcReading & (PRESSURE_LUT_PAGE_SIZE - 1)];
+}
+
+/* This function converts an ADC reading through the cache, with the same result as
+*  ConvertADCReadingToPressure(...) on the descriptor of the cache.
+*/
+int32_t PressureLUTCache_Convert(PressureLUTCache* cachePtr, uint16_t adcReading) {
+    const int32_t* page = cachePtr->pages[adcReading >> PRESSURE_LUT_PAGE_SHIFT];
+
+    if (page != NULL) {
+        cachePtr->hits++;
+        return page[adcReading & (PRESSURE_LUT_PAGE_SIZE - 1)];
+    }
+    return ConvertMiss(cachePtr, adcReading);
+}
+
+/* This function converts a buffer of ADC readings through the cache, with the same results as
+*  ConvertADCBufferToPressure(...) on the descriptor of the cache.
+*/
+void PressureLUTCache_ConvertBuffer(PressureLUTCache* cachePtr, const uint16_t* in, int32_t* out, size_t n) {
+    // The hits are counted locally, so that the loop does not store to the cache on every reading.
+    uint64_t hits = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const int32_t* page = cachePtr->pages[in[i] >> PRESSURE_LUT_PAGE_SHIFT];
+
+        if (page != NULL) {
+            out[i] = page[in[i] & (PRESSURE_LUT_PAGE_SIZE - 1)];
+            hits++;
+        }
+        else {
+            out[i] = ConvertMiss(cachePtr, in[i]);
+        }
+    }
+    cachePtr->hits += hits;
+}
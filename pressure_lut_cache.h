@@ -0,0 +1,42 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Paged LUT Cache
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Lazily filled cache of the dense table of a descriptor, by pages of ADC readings (see pressure_lut_cache.c).
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_LUT_CACHE_H
+#define PRESSURE_LUT_CACHE_H
+
+#include "pressure_sensor.h"
+
+// Every page of the cache holds the pressures of 2^PRESSURE_LUT_PAGE_SHIFT consecutive ADC readings.
+#define PRESSURE_LUT_PAGE_SHIFT 8
+#define PRESSURE_LUT_PAGE_SIZE (1u << PRESSURE_LUT_PAGE_SHIFT)
+#define PRESSURE_LUT_PAGE_COUNT (PRESSURE_LUT_SIZE >> PRESSURE_LUT_PAGE_SHIFT)
+
+typedef struct {
+    const PressureTable* table;
+    // Filled page of every ADC reading >> PRESSURE_LUT_PAGE_SHIFT, NULL until it is first needed.
+    int32_t* pages[PRESSURE_LUT_PAGE_COUNT];
+    // Memory of the pages, provided by the caller: poolPages * PRESSURE_LUT_PAGE_SIZE values.
+    int32_t* pool;
+    uint16_t poolPages;
+    uint16_t usedPages;
+    // Number of pages filled, of readings served from an already filled page, and of readings converted
+    // without the cache because the pool was full.
+    uint64_t pageFills;
+    uint64_t hits;
+    uint64_t uncached;
+} PressureLUTCache;
+
+void PressureLUTCache_Init(PressureLUTCache* cachePtr, const PressureTable* tablePtr, int32_t* pool, uint16_t poolPages);
+void PressureLUTCache_Reset(PressureLUTCache* cachePtr);
+int32_t PressureLUTCache_Convert(PressureLUTCache* cachePtr, uint16_t adcReading);
+void PressureLUTCache_ConvertBuffer(PressureLUTCache* cachePtr, const uint16_t* in, int32_t* out, size_t n);
+
+#endif // PRESSURE_LUT_CACHE_H
@@ -0,0 +1,98 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Piecewise-Polynomial Tables
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts ADC readings with the piecewise-polynomial form of a Pressure-ADC table, which
+*   replaces a large calibration table (e.g. 4096 points) with a few polynomial segments fitted offline
+*   by the table generator (see tools/poly_fit.c). The segments have any length, so the segment of a
+*   reading is found with a binary search over their first readings (a few steps, as a smooth curve needs
+*   a handful of segments), or reused from the previous sample of a buffer. The polynomial is then
+*   evaluated with Horner's method in fixed-point integer arithmetic, on the position of the reading
+*   scaled by a power of two at least as large as the segment:
+*       t = (ADC - ADC0) / 2^segmentShift, as a Q16 value
+*       P = (((c3 * t + c2) * t + c1) * t + c0) / 2^PRESSURE_POLY_COEFFICIENT_SHIFT, rounded
+*   The results are not identical to the conversion with the full table, but the generator checks every
+*   ADC reading within the table bounds against it, and only emits coefficients whose maximum error is
+*   within the requested bound (e.g. 1, i.e. 0.01 KPa). Readings outside of the table bounds are
+*   extrapolated with the fit of the table, as by ConvertADCReadingToPressure(...).
+*
+*   IMPORTANT: The evaluation requires 64-bit integers, like the extrapolation.
+*
+***************************************************************************************************/
+
+#include "pressure_sensor.h"
+
+// Number of fractional bits of the position of a reading within its segment.
+#define POLY_POSITION_SHIFT 16
+
+/* Finds the segment containing the ADC reading, for minADC <= adcReading <= maxADC, i.e. the last
+*  segment starting at or below it.
+*/
+static uint16_t FindPolySegment(const PressurePolyTable* t, uint16_t adcReading) {
+    uint16_t low = 0;
+    uint16_t high = t->segmentCount - 1;
+
+    while (low < high) {
+        const uint16_t middle = (uint16_t)((low + high + 1u) >> 1);
+        if (t->segmentStarts[middle] <= adcReading) {
+            low = middle;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/* Evaluates the polynomial of the given segment, which contains the ADC reading. */
+static int32_t EvaluatePoly(const PressurePolyTable* t, uint16_t segment, uint16_t adcReading) {
+    const int32_t* coefficients = &t->coefficients[segment * (t->degree + 1u)];
+    // The position within the segment, scaled from segmentShift to POLY_POSITION_SHIFT bits.
+    const int64_t position = (int64_t)(adcReading - t->segmentStarts[segment]) << (POLY_POSITION_SHIFT - t->segmentShifts[segment]);
+    int64_t value = coefficients[t->degree];
+
+    for (int16_t k = (int16_t)t->degree - 1; k >= 0; k--) {
+        value = ((value * position) >> POLY_POSITION_SHIFT) + coefficients[k];
+    }
+    return (int32_t)((value + (1 << (PRESSURE_POLY_COEFFICIENT_SHIFT - 1))) >> PRESSURE_POLY_COEFFICIENT_SHIFT);
+}
+
+/* This function converts an ADC reading with the piecewise-polynomial form of a table, within the
+*  maximum error the table was generated with.
+*/
+int ConvertADCReadingToPressurePoly(int adcReading, const PressurePolyTable* tablePtr) {
+    if ((adcReading < tablePtr->minADC) || (adcReading > tablePtr->maxADC)) {
+        return tablePtr->fit.slope * adcReading + tablePtr->fit.intercept;
+    }
+    return EvaluatePoly(tablePtr, FindPolySegment(tablePtr, (uint16_t)adcReading), (uint16_t)adcReading);
+}
+
+/* This function converts a buffer of ADC readings with the piecewise-polynomial form of a table, with
+*  the same results as ConvertADCReadingToPressurePoly(...) on every sample. The segment of the previous
+*  sample is checked first, so a slowly changing signal is converted without any search.
+*/
+void ConvertADCBufferToPressurePoly(const uint16_t* in, int32_t* out, size_t n, const PressurePolyTable* t) {
+    const uint16_t minADC = t->minADC;
+    const uint16_t maxADC = t->maxADC;
+    const int64_t slope = t->fit.slope;
+    const int64_t intercept = t->fit.intercept;
+    uint16_t segment = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t adcReading = in[i];
+
+        if ((adcReading < minADC) || (adcReading > maxADC)) {
+            out[i] = slope * adcReading + intercept;
+        }
+        else {
+            if ((adcReading < t->segmentStarts[segment]) ||
+                (((segment + 1u) < t->segmentCount) && (adcReading >= t->segmentStarts[segment + 1]))) {
+                segment = FindPolySegment(t, adcReading);
+            }
+            out[i] = EvaluatePoly(t, segment, adcReading);
+        }
+    }
+}
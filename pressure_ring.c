@@ -0,0 +1,174 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Conversion In Place Of The DMA Buffer
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts the readings of the circular DMA buffer of the ADC into packed 16 or 24 bit
+*   pressure readings (see PressurePackedFormat), so that the DMA stage and the consumer share one buffer
+*   instead of a second array of 32 bit pressures and a copy between them. In 16 bits, the pressures are
+*   written over the ADC readings themselves, and no other buffer is needed at all. In 24 bits, they go to
+*   a ring of 3 bytes per reading provided by the caller.
+*
+*   The DMA buffer is used as two halves: PressureRing_OnHalfComplete(...) and PressureRing_OnComplete(...)
+*   are called from the DMA half-complete and complete callbacks, convert the half the DMA just filled and
+*   advance the head of the ring. The consumer gets the oldest converted half with PressureRing_Acquire(...),
+*   reads its pressures with PressurePacked_Get(...), and hands it back with PressureRing_Release(...).
+*   The consumer has to keep up with the DMA: once a half has been converted, the DMA overwrites the other
+*   one, so a half still pending when its neighbour completes is lost. The consumer then skips to the most
+*   recent half and counts the lost ones as overruns. Every callback records the half it converted, so
+*   the DMA may start on either callback, and a missed callback does not swap the halves.
+*
+*   The head is only written by the callbacks and the tail only by the consumer, and both are single
+*   bytes, so no locking or interrupt masking is needed, even on an 8-bit microcontroller.
+*
+***************************************************************************************************/
+
+#include "pressure_sensor.h"
+
+#if defined(__GNUC__)
+#define LOAD_INDEX(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define STORE_INDEX(index, value) __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+#else
+#define LOAD_INDEX(index) (index)
+#define STORE_INDEX(index, value) ((index) = (value))
+#endif
+
+// Number of readings converted at a time into 32 bits before being packed, which bounds the stack used.
+#define PACKED_CHUNK_LENGTH 8
+
+/* Packs one pressure reading, saturating it to the width of the format. */
+static void PackPressure(const PressurePackedFormat* formatPtr, uint8_t* packed, size_t i, int32_t pressure) {
+    // The offset is subtracted in 64 bits, since an extrapolated pressure may be close to the 32 bit limits.
+    int64_t value = ((int64_t)pressure - formatPtr->offset) >> formatPtr->shift;
+
+    if (formatPtr->width == PRESSURE_PACKED_16) {
+        uint16_t packedValue = (value < 0) ? 0 : ((value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value);
+        packed[2 * i] = (uint8_t)packedValue;
+        packed[2 * i + 1] = (uint8_t)(packedValue >> 8);
+    }
+    else {
+        const int32_t maxValue = (1L << 23) - 1;
+        int32_t packedValue = (value < -maxValue - 1) ? (-maxValue - 1) : ((value > maxValue) ? maxValue : (int32_t)value);
+        packed[3 * i] = (uint8_t)packedValue;
+        packed[3 * i + 1] = (uint8_t)(packedValue >> 8);
+        packed[3 * i + 2] = (uint8_t)(packedValue >> 16);
+    }
+}
+
+/* This function returns pressure reading i of a packed buffer, in 0.01 KPa. */
+int32_t PressurePacked_Get(const PressurePackedFormat* formatPtr, const uint8_t* packed, size_t i) {
+    int32_t value;
+
+    if (formatPtr->width == PRESSURE_PACKED_16) {
+        value = (int32_t)((uint16_t)packed[2 * i] | ((uint16_t)packed[2 * i + 1] << 8));
+    }
+    else {
+        uint32_t bits = (uint32_t)packed[3 * i] | ((uint32_t)packed[3 * i + 1] << 8) | ((uint32_t)packed[3 * i + 2] << 16);
+        // Sign extension of the 24 bit value.
+        value = (int32_t)(bits ^ 0x800000UL) - 0x800000L;
+    }
+    return (int32_t)(value * (1L << formatPtr->shift)) + formatPtr->offset;
+}
+
+/* This function converts a buffer of ADC readings into packed pressure readings, with the same results as
+*  ConvertADCBufferToPressure(...) before packing. In 16 bits, out may be the input buffer itself: every
+*  reading is read before its packed pressure is written in its place. In 24 bits, out must not overlap in.
+*/
+void ConvertADCBufferToPressurePacked(const uint16_t* in, uint8_t* out, size_t n, const PressureTable* t, const PressurePackedFormat* formatPtr) {
+    int32_t pressures[PACKED_CHUNK_LENGTH];
+
+    for (size_t first = 0; first < n; first += PACKED_CHUNK_LENGTH) {
+        size_t length = ((n - first) < PACKED_CHUNK_LENGTH) ? (n - first) : PACKED_CHUNK_LENGTH;
+
+        ConvertADCBufferToPressure(&in[first], pressures, length, t);
+        for (size_t i = 0; i < length; i++) {
+            PackPressure(formatPtr, out, first + i, pressures[i]);
+        }
+    }
+}
+
+/* This function sets up an empty ring over the circular DMA buffer adc (2 * halfLength readings). The
+*  packed pressures go to pressures (2 * halfLength * 3 bytes) in 24 bits, and in place of the ADC
+*  readings in 16 bits when pressures is NULL. Returns 0 on success, or -1 if the 24 bit pressures have
+*  no buffer of their own.
+*/
+int16_t PressureRing_Init(PressureRing* ringPtr, const PressureTable* tablePtr, uint16_t* adc, uint8_t* pressures, uint16_t halfLength, const PressurePackedFormat* formatPtr) {
+    if (pressures == NULL) {
+        if (formatPtr->width != PRESSURE_PACKED_16) {
+            return -1;
+        }
+        pressures = (uint8_t*)adc;
+    }
+    ringPtr->table = tablePtr;
+    ringPtr->adc = adc;
+    ringPtr->pressures = pressures;
+    ringPtr->halfLength = halfLength;
+    ringPtr->format = *formatPtr;
+    ringPtr->overruns = 0;
+    ringPtr->halves[0] = 0;
+    ringPtr->halves[1] = 1;
+    STORE_INDEX(ringPtr->tail, 0);
+    STORE_INDEX(ringPtr->head, 0);
+    return 0;
+}
+
+/* Converts the given half of the DMA buffer and publishes it to the consumer, recording which half it is,
+*  so that a stream started on the complete callback, or a missed callback, still hands the consumer the
+*  half that was actually converted.
+*/
+static void ConvertHalf(PressureRing* ringPtr, uint8_t half) {
+    const size_t first = (size_t)half * ringPtr->halfLength;
+    const size_t packedSize = (ringPtr->format.width == PRESSURE_PACKED_16) ? 2 : 3;
+    const uint8_t head = LOAD_INDEX(ringPtr->head);
+
+    ConvertADCBufferToPressurePacked(&ringPtr->adc[first], &ringPtr->pressures[first * packedSize], ringPtr->halfLength,
+                                     ringPtr->table, &ringPtr->format);
+    ringPtr->halves[head & 1] = half;
+    STORE_INDEX(ringPtr->head, (uint8_t)(head + 1));
+}
+
+/* This function is to be called from the DMA half-complete callback, once the first half is filled. */
+void PressureRing_OnHalfComplete(PressureRing* ringPtr) {
+    ConvertHalf(ringPtr, 0);
+}
+
+/* This function is to be called from the DMA complete callback, once the second half is filled. */
+void PressureRing_OnComplete(PressureRing* ringPtr) {
+    ConvertHalf(ringPtr, 1);
+}
+
+/* This function returns the oldest converted half of the ring (halfLength packed pressures, to be read
+*  with PressurePacked_Get(...)), or NULL if none is pending. It remains valid until PressureRing_Release(...),
+*  provided that the consumer keeps up with the DMA.
+*/
+const uint8_t* PressureRing_Acquire(PressureRing* ringPtr) {
+    const uint8_t head = LOAD_INDEX(ringPtr->head);
+    uint8_t tail = ringPtr->tail;
+    const uint8_t pending = (uint8_t)(head - tail);
+    const size_t packedSize = (ringPtr->format.width == PRESSURE_PACKED_16) ? 2 : 3;
+
+    if (pending == 0) {
+        return NULL;
+    }
+    if (pending > 1) {
+        // The older halves have been overwritten, only the most recent one is still intact.
+        ringPtr->overruns += pending - 1;
+        tail = (uint8_t)(head - 1);
+        STORE_INDEX(ringPtr->tail, tail);
+    }
+    return &ringPtr->pressures[(size_t)ringPtr->halves[tail & 1] * ringPtr->halfLength * packedSize];
+}
+
+/* This function hands the half returned by PressureRing_Acquire(...) back to the ring. It does nothing
+*  if no half is pending, so that the tail never moves past the head.
+*/
+void PressureRing_Release(PressureRing* ringPtr) {
+    const uint8_t tail = ringPtr->tail;
+
+    if (LOAD_INDEX(ringPtr->head) == tail) {
+        return;
+    }
+    STORE_INDEX(ringPtr->tail, (uint8_t)(tail + 1));
+}
@@ -0,0 +1,863 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module provides the functionality to convert ADC readings from a precision sensor into pressure 
+*   values based on a given  mapping. The primary consideration of this module was the resource constrained 
+*   nature of its application.
+*
+***************************************************************************************************/
+
+#include <string.h>
+
+#include "pressure_sensor.h"
+
+#if defined(__GNUC__)
+#define PRESSURE_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PRESSURE_PREFETCH(address)
+#endif
+
+// Instrumentation of the conversion functions (see PressureStats), compiled to nothing unless enabled.
+#if defined(PRESSURE_INSTRUMENTATION)
+#define PRESSURE_STATS(statement) statement
+// Extra argument of the search functions, the step counter of the caller's search (or NULL not to count).
+#define PRESSURE_STATS_ARG(argument) , argument
+#if !defined(PRESSURE_STATS_CYCLES)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PRESSURE_STATS_CYCLES() ((uint32_t)__builtin_ia32_rdtsc())
+#else
+#define PRESSURE_STATS_CYCLES() 0u
+#endif
+#endif
+
+PressureStats pressureStats = { .minCycles = UINT32_MAX, .minBufferCycles = UINT32_MAX };
+
+/* This function clears the instrumentation counters. */
+void PressureStats_Reset(void) {
+    memset(&pressureStats, 0, sizeof(pressureStats));
+    pressureStats.minCycles = UINT32_MAX;
+    pressureStats.minBufferCycles = UINT32_MAX;
+}
+
+/* Bins a finished search into the histogram by its number of steps, counted by the caller. */
+static void RecordSearch(uint16_t searchSteps) {
+    pressureStats.searchDepth[(searchSteps < PRESSURE_STATS_DEPTH_BINS) ? searchSteps : (PRESSURE_STATS_DEPTH_BINS - 1)]++;
+}
+
+static void RecordRange(int16_t outOfRange) {
+    if (!outOfRange) {
+        pressureStats.currentOutOfRangeRun = 0;
+        return;
+    }
+    if (pressureStats.currentOutOfRangeRun == 0) {
+        pressureStats.outOfRangeRuns++;
+    }
+    pressureStats.currentOutOfRangeRun++;
+    if (pressureStats.currentOutOfRangeRun > pressureStats.longestOutOfRangeRun) {
+        pressureStats.longestOutOfRangeRun = pressureStats.currentOutOfRangeRun;
+    }
+}
+
+static void RecordCycles(uint32_t cycles, uint32_t* minCyclesPtr, uint32_t* maxCyclesPtr) {
+    if (cycles < *minCyclesPtr) {
+        *minCyclesPtr = cycles;
+    }
+    if (cycles > *maxCyclesPtr) {
+        *maxCyclesPtr = cycles;
+    }
+}
+#else
+#define PRESSURE_STATS(statement)
+#define PRESSURE_STATS_ARG(argument)
+#endif
+
+// Number of levels the Eytzinger search prefetches ahead. The 2^5 descendants of a slot 5 levels
+// down are 32 contiguous 16 bit keys, i.e. a single cache line.
+#define EYTZINGER_PREFETCH_LEVELS 5
+
+/* Binary search for the segment [entries[segment].adc, entries[segment + 1].adc) that contains the
+*  ADC reading. The caller must ensure that entries[0].adc <= adcReading < entries[tableSize].adc.
+*  An exact match with an entry returns that entry as the start of its segment.
+*/
+static int16_t FindSegment(const PressureTableEntry* entries, int16_t tableSize, uint16_t adcReading PRESSURE_STATS_ARG(uint16_t* stepsPtr)) {
+    int16_t searchWindowStart = 0;
+    int16_t searchWindowEnd = tableSize;
+
+    while ((searchWindowEnd - searchWindowStart) > 1) {
+        int16_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+        PRESSURE_STATS(if (stepsPtr != NULL) { (*stepsPtr)++; });
+        if (adcReading < entries[midPoint].adc) {
+            searchWindowEnd = midPoint;
+        }
+        else {
+            searchWindowStart = midPoint;
+        }
+    }
+    return searchWindowStart;
+}
+
+/* Searches the Eytzinger layout of the ADC readings for the segment that contains the ADC reading, with
+*  the same result as FindSegment(...). Every level compares the reading with one key and descends to the
+*  left or right child through an addition rather than a branch. Once at the bottom, the path taken is
+*  encoded in the bits of the slot: the trailing 1 bits are the right turns taken after the last left
+*  turn, and shifting them out (with the left turn) gives the slot of the first key greater than the 
+*  reading, whose entry ends the segment. The caller must ensure that entries[0].adc <= adcReading < 
+*  entries[tableSize].adc.
+*/
+static int16_t SearchEytzinger(const PressureEytzinger* pressureEytzingerPtr, uint16_t adcReading PRESSURE_STATS_ARG(uint16_t* stepsPtr)) {
+    const uint16_t* keys = pressureEytzingerPtr->keys;
+    uint32_t slot = 1;
+
+    for (uint8_t level = 0; level < pressureEytzingerPtr->depth; level++) {
+        // Prefetching beyond the end of the keys is harmless, it never faults.
+        PRESSURE_PREFETCH(&keys[slot << EYTZINGER_PREFETCH_LEVELS]);
+        slot = 2 * slot + (keys[slot] <= adcReading);
+    }
+    PRESSURE_STATS(if (stepsPtr != NULL) { *stepsPtr += pressureEytzingerPtr->depth; });
+#if defined(__GNUC__)
+    slot >>= __builtin_ctz(~slot) + 1;
+#else
+    while (slot & 1) {
+        slot >>= 1;
+    }
+    slot >>= 1;
+#endif
+    return (int16_t)(pressureEytzingerPtr->ranks[slot] - 1);
+}
+
+/* Interpolates the pressure reading within the given segment. When the precomputed fixed-point segment 
+*  slopes are provided, this is one multiply and one shift, rounding to the nearest pressure unit. 
+*  Otherwise, the slope is computed with the same formula (and hence the same integer truncation) as 
+*  originally used by ConvertADCReadingToPressure(...). For a table with a uniform pressure step, P1 is
+*  computed from the segment rather than loaded from the table, and P2 - P1 is the step.
+*/
+static int32_t InterpolateSegment(const PressureTableEntry* entries, const int32_t* slopes, int32_t pressureStep, int16_t segment, uint16_t adcReading) {
+    int32_t P1 = (pressureStep != 0) ? (entries[0].pressure + pressureStep * segment) : entries[segment].pressure;
+    uint16_t ADC1 = entries[segment].adc;
+
+    if (slopes != NULL) {
+        int32_t offset = slopes[segment] * (int32_t)(adcReading - ADC1);
+        return P1 + ((offset + (1L << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+    }
+    else {
+        int32_t P2 = (pressureStep != 0) ? (P1 + pressureStep) : entries[segment + 1].pressure;
+        uint16_t ADC2 = entries[segment + 1].adc;
+        return P1 + ((P2 - P1) / (ADC2 - ADC1)) * (adcReading - ADC1);
+    }
+}
+
+/* Looks up the segment containing the ADC reading through the direct segment index. The index gives
+*  the first segment of the reading's bucket, so at most a couple of linear steps follow, which keeps 
+*  the lookup time almost constant. The caller must ensure that entries[0].adc <= adcReading < 
+*  entries[tableSize].adc.
+*/
+static int16_t LookupSegment(const PressureTableEntry* entries, const PressureIndex* pressureIndexPtr, uint16_t adcReading
+                             PRESSURE_STATS_ARG(uint16_t* stepsPtr)) {
+    int16_t segment = pressureIndexPtr->segments[(adcReading >> PRESSURE_INDEX_SHIFT) - pressureIndexPtr->firstBucket];
+
+    while (adcReading >= entries[segment + 1].adc) {
+        segment++;
+        PRESSURE_STATS(if (stepsPtr != NULL) { (*stepsPtr)++; });
+    }
+    return segment;
+}
+
+/* Finds the segment of an in-range ADC reading, entries[0].adc <= adcReading < entries[tableSize].adc,
+*  checking the given segment (e.g. that of the previous reading) and its neighbours first, so that a
+*  slowly varying reading crossing a table entry does not search the table. Only a larger jump falls back
+*  to the direct index, the Eytzinger layout or the binary search. The neighbours need no bounds checks,
+*  as the reading is within the table. With instrumentation, the steps of that search are added to
+*  *stepsPtr, unless it is NULL.
+*/
+static int16_t TrackSegment(const PressureTable* t, int16_t segment, uint16_t adcReading PRESSURE_STATS_ARG(uint16_t* stepsPtr)) {
+    const PressureTableEntry* entries = t->entries;
+
+    if (adcReading < entries[segment].adc) {
+        if (adcReading >= entries[segment - 1].adc) {
+            return segment - 1;
+        }
+    }
+    else if (adcReading < entries[segment + 1].adc) {
+        return segment;
+    }
+    else if (adcReading < entries[segment + 2].adc) {
+        return segment + 1;
+    }
+    if (t->index != NULL) {
+        return LookupSegment(entries, t->index, adcReading PRESSURE_STATS_ARG(stepsPtr));
+    }
+    if (t->eytzinger != NULL) {
+        return SearchEytzinger(t->eytzinger, adcReading PRESSURE_STATS_ARG(stepsPtr));
+    }
+    return FindSegment(entries, t->tableSize, adcReading PRESSURE_STATS_ARG(stepsPtr));
+}
+
+/* This function will follow the below algorithm steps:
+*   1. Determine if the ADC sensor reading to convert to a pressure value is within the bounds 
+*      of the saved Presure to ADC Sensor Reading table. 
+*   2. If it is, then either the entry will be found directly or interpolation will be used to 
+*      determine the appropriate pressure reading associated with the ADC reading.
+*        2a. Prior to performing the interpolation, the direct segment index or the Eytzinger layout 
+*            (when provided) or a binary search is used. The binary search is performed to either
+*            find the entry directly our find the (P1, ADC1) and (P2, ADC2) that are closest to it.
+*            This occurs when (int) ((searchWindowEnd - searchWindowStart) / 2) == 0. In performing
+*            this, we are taking advantage of the fact that integer division always rounds down in C
+*            programming.
+*        2b. The next step would be to perform the interpolation using the following formula.
+*              Interpolation formula: m = (P2 - P1)/(ADC2 - ADC1) => P = P1 + m * (ADC - ADC1)
+*                Where, (P1, ADC1) and (P2, ADC2) are the two Pressure-ADCSensor
+*                mapping pairs closest to the provided reading, ADC is the provided sensor reading
+*                value, and P is the output pressure reading.
+*            When the segment slopes are provided, m is read from them as a fixed-point value with
+*            PRESSURE_SLOPE_SHIFT fractional bits instead of being computed with a division. When the
+*            table has a uniform pressure step, P1 = P0 + step * segment is computed rather than loaded.
+*   3. If it is not, then the least-squares linear fit of the table, precomputed by PressureFit_Init(...),
+*      is used to extrapolate for the appropriate pressure reading given the input ADC reading. This 
+*      costs a single multiply-add per reading.
+*    
+*   The table, its size, the extrapolation fit and the optional index and slopes are all taken from the
+*   table descriptor, so a single implementation serves any number of sensor channels, each with its
+*   own calibration table, without any per-call size or fit computation.
+*    
+*   IMPORTANT: The below function provides a method for extrapolation which requires 64-bit integers.
+*              If this variable type does not exist in the microcontroller environment, then extrapolation
+*              is not possible.
+*/
+int ConvertADCReadingToPressure(int adcReading, const PressureTable* tablePtr) {
+    // Total amount of RAM used by run-time variables: 24 Bytes
+    // NOTE: The pressureTable size is not included since running this function in the microcontroller 
+    //       use-case allows for this table to be be allocated in Flash memory. Further explanations
+    //       are in points 2 and 3 under the heading "Developer Notes".
+    
+    const PressureTableEntry* pressureTablePtr = tablePtr->entries;
+    const int16_t tableSize = tablePtr->tableSize;
+    const PressureIndex* pressureIndexPtr = tablePtr->index;
+    const int32_t* segmentSlopesPtr = tablePtr->slopes;
+    const int32_t pressureStep = tablePtr->pressureStep;
+    int32_t pressure = 0;
+    PRESSURE_STATS(const uint32_t startCycles = PRESSURE_STATS_CYCLES());
+    PRESSURE_STATS(uint16_t searchSteps = 0);
+
+    PRESSURE_STATS(RecordRange((adcReading < pressureTablePtr[0].adc) || (adcReading > pressureTablePtr[tableSize].adc)));
+    if ((tablePtr->lut != NULL) && (adcReading >= 0) && (adcReading <= UINT16_MAX)) {
+        pressure = tablePtr->lut[adcReading];
+        PRESSURE_STATS(pressureStats.lutHits++);
+    }
+    else if ((adcReading >= pressureTablePtr[0].adc) && (adcReading <= pressureTablePtr[tableSize].adc)) {
+        // The Pressure reading can either be found in the table or can be interpolated.
+        // To find the pressure reading in the table, we perform a binary search by taking
+        // advantage of the sorted nature of the table and optimize the program for speed.
+        
+        int16_t searchWindowStart = 0;
+        int16_t searchWindowEnd = tableSize;
+        int16_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+        int16_t readingFound = 0;
+        
+        // First check the first and last element of the table, if the ADC Reading is found, 
+        // return the associated Pressure reading.
+        if (adcReading == pressureTablePtr[0].adc) {
+            readingFound = 1;
+            pressure = pressureTablePtr[0].pressure;
+            PRESSURE_STATS(pressureStats.exactHits++);
+        }
+        else if (adcReading == pressureTablePtr[tableSize].adc) {
+            readingFound = 1;
+            pressure = pressureTablePtr[tableSize].pressure;
+            PRESSURE_STATS(pressureStats.exactHits++);
+        }
+        else if (pressureIndexPtr != NULL) {
+            // Jump straight to the segment through the direct index, which takes an almost constant
+            // time, and interpolate within it. An exact match is the start of its segment.
+            int16_t segment = LookupSegment(pressureTablePtr, pressureIndexPtr, adcReading PRESSURE_STATS_ARG(&searchSteps));
+            pressure = InterpolateSegment(pressureTablePtr, segmentSlopesPtr, pressureStep, segment, adcReading);
+            PRESSURE_STATS(pressureStats.interpolations++);
+            PRESSURE_STATS(RecordSearch(searchSteps));
+        }
+        else if (tablePtr->eytzinger != NULL) {
+            // Search the Eytzinger layout of the ADC readings, without a branch per level, and
+            // interpolate within the segment. An exact match is the start of its segment.
+            int16_t segment = SearchEytzinger(tablePtr->eytzinger, adcReading PRESSURE_STATS_ARG(&searchSteps));
+            pressure = InterpolateSegment(pressureTablePtr, segmentSlopesPtr, pressureStep, segment, adcReading);
+            PRESSURE_STATS(pressureStats.interpolations++);
+            PRESSURE_STATS(RecordSearch(searchSteps));
+        }
+        else {
+            // The requested ADC Reading was not there, so perform a binary search
+            while (readingFound == 0) {
+                PRESSURE_STATS(searchSteps++);
+                if (adcReading == pressureTablePtr[midPoint].adc) {
+                    readingFound = 1;
+                    pressure = pressureTablePtr[midPoint].pressure;
+                    PRESSURE_STATS(pressureStats.exactHits++);
+                }
+                else if (midPoint == searchWindowStart) {
+                    // The entries surrounding the input ADC Reading have been found.
+                    // Use the interpolation formula to output the Pressur Reading
+                    readingFound = 1;
+                    pressure = InterpolateSegment(pressureTablePtr, segmentSlopesPtr, pressureStep, searchWindowStart, adcReading);
+                    PRESSURE_STATS(pressureStats.interpolations++);
+                }
+                else if (adcReading < pressureTablePtr[midPoint].adc) {
+                    // The ADC Reading is in the first half of the search window
+                    searchWindowEnd = midPoint;
+                    midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+                }
+                else if (adcReading > pressureTablePtr[midPoint].adc) {
+                    // The ADC Reading is in the second half of the search window
+                    searchWindowStart = midPoint;
+                    midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+                }
+            }
+            PRESSURE_STATS(RecordSearch(searchSteps));
+        }
+    }
+    else {
+        // The Pressure reading must be extrapolated using the precomputed least-squares fit.
+        pressure = tablePtr->fit.slope * adcReading + tablePtr->fit.intercept;
+        PRESSURE_STATS(pressureStats.extrapolations++);
+    }
+    PRESSURE_STATS(RecordCycles(PRESSURE_STATS_CYCLES() - startCycles, &pressureStats.minCycles, &pressureStats.maxCycles));
+    return pressure;
+}
+
+/* This function converts a buffer of ADC readings (e.g. one half of a circular DMA buffer) to pressure
+*  readings, giving the same results as calling ConvertADCReadingToPressure(...) on every sample.
+*  The table bounds and the extrapolation fit are loaded once for the whole buffer, and the segment of 
+*  the previous sample and its neighbours are checked before falling back to the direct index, the
+*  Eytzinger layout or the binary search. Since the pressure is a slow physical process relative to the
+*  sample rate, consecutive samples almost always fall in the same segment, which makes the lookup O(1)
+*  for most samples.
+*/
+void ConvertADCBufferToPressure(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    const PressureTableEntry* entries = t->entries;
+    const int16_t tableSize = t->tableSize;
+    const uint16_t minADC = entries[0].adc;
+    const uint16_t maxADC = entries[tableSize].adc;
+    const int64_t slope = t->fit.slope;
+    const int64_t intercept = t->fit.intercept;
+    const int32_t* segmentSlopesPtr = t->slopes;
+    const int32_t pressureStep = t->pressureStep;
+    const int32_t* lut = t->lut;
+    int16_t segment = 0;
+    PRESSURE_STATS(const uint32_t startCycles = PRESSURE_STATS_CYCLES());
+
+    if (lut != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = lut[in[i]];
+            PRESSURE_STATS(RecordRange((in[i] < minADC) || (in[i] > maxADC)));
+        }
+        PRESSURE_STATS(pressureStats.lutHits += n);
+        PRESSURE_STATS(RecordCycles(PRESSURE_STATS_CYCLES() - startCycles, &pressureStats.minBufferCycles, &pressureStats.maxBufferCycles));
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint16_t adcReading = in[i];
+
+        PRESSURE_STATS(RecordRange((adcReading < minADC) || (adcReading > maxADC)));
+        if ((adcReading < minADC) || (adcReading > maxADC)) {
+            out[i] = slope * adcReading + intercept;
+            PRESSURE_STATS(pressureStats.extrapolations++);
+        }
+        else if (adcReading == maxADC) {
+            out[i] = entries[tableSize].pressure;
+            PRESSURE_STATS(pressureStats.exactHits++);
+        }
+        else {
+            PRESSURE_STATS(const int16_t previousSegment = segment);
+            PRESSURE_STATS(uint16_t searchSteps = 0);
+
+            // Only search the table when the reading left the segment of the previous sample and its neighbours.
+            segment = TrackSegment(t, segment, adcReading PRESSURE_STATS_ARG(&searchSteps));
+            // TrackSegment(...) only searches when the reading is in none of these three segments, so a
+            // search never ends within one segment of the previous one.
+            PRESSURE_STATS(if ((segment >= (previousSegment - 1)) && (segment <= (previousSegment + 1))) { pressureStats.segmentReuses++; }
+                           else { RecordSearch(searchSteps); });
+            out[i] = InterpolateSegment(entries, segmentSlopesPtr, pressureStep, segment, adcReading);
+            PRESSURE_STATS(pressureStats.interpolations++);
+        }
+    }
+    PRESSURE_STATS(RecordCycles(PRESSURE_STATS_CYCLES() - startCycles, &pressureStats.minBufferCycles, &pressureStats.maxBufferCycles));
+}
+
+/* Interpolates the pressure within the given segment at an ADC reading with fractionShift fractional bits
+*  (0 to 16), e.g. the sum of 2^fractionShift oversampled readings, as a pressure with PRESSURE_SLOPE_SHIFT
+*  fractional bits. With the segment slopes, this is a multiply and a shift. Without them, the slope is
+*  divided out on every interpolation, but is not truncated to whole pressure units.
+*/
+static int64_t InterpolateSegmentQ16(const PressureTableEntry* entries, const int32_t* slopes, int32_t pressureStep, int16_t segment,
+                                     uint32_t adcReading, uint8_t fractionShift) {
+    int32_t P1 = (pressureStep != 0) ? (entries[0].pressure + pressureStep * segment) : entries[segment].pressure;
+    // Distance of the reading from ADC1, with fractionShift fractional bits.
+    int64_t distance = (int64_t)adcReading - ((int64_t)entries[segment].adc << fractionShift);
+
+    if (slopes != NULL) {
+        return (int64_t)P1 * (1L << PRESSURE_SLOPE_SHIFT) + ((slopes[segment] * distance) >> fractionShift);
+    }
+    else {
+        int32_t P2 = (pressureStep != 0) ? (P1 + pressureStep) : entries[segment + 1].pressure;
+        int64_t adcStep = (int64_t)(entries[segment + 1].adc - entries[segment].adc) << fractionShift;
+        int64_t offset = (int64_t)(P2 - P1) * distance * (1L << PRESSURE_SLOPE_SHIFT);
+        // Rounded down on either side of zero, like the shift of the slopes.
+        int64_t quotient = offset / adcStep;
+        return (int64_t)P1 * (1L << PRESSURE_SLOPE_SHIFT) + quotient - (((offset % adcStep) < 0) ? 1 : 0);
+    }
+}
+
+/* Interpolates the pressure within the given segment at an ADC reading with fractionShift fractional bits,
+*  rounded to the nearest pressure unit. With fractionShift = 0, the result is the same as
+*  InterpolateSegment(...) with the slopes.
+*/
+static int32_t InterpolateSegmentFraction(const PressureTableEntry* entries, const int32_t* slopes, int32_t pressureStep, int16_t segment,
+                                          uint32_t adcReading, uint8_t fractionShift) {
+    int64_t pressure = InterpolateSegmentQ16(entries, slopes, pressureStep, segment, adcReading, fractionShift);
+    return (int32_t)((pressure + (1L << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+}
+
+/* This function initializes the conversion context of a sensor channel, with its table and the hit and
+*  miss counters cleared. Every channel converted with ConvertADCReadingToPressureTracked(...) needs its
+*  own context.
+*/
+void PressureTracker_Init(PressureTracker* trackerPtr, const PressureTable* tablePtr) {
+    trackerPtr->table = tablePtr;
+    trackerPtr->segment = 0;
+    trackerPtr->hits = 0;
+    trackerPtr->misses = 0;
+}
+
+/* This function converts an ADC reading of a sensor channel, giving the same result as
+*  ConvertADCReadingToPressure(...) with the table of the context, e.g. one reading per ISR tick. Like
+*  ConvertADCBufferToPressure(...), it checks the segment of the previous reading and its neighbours
+*  first, and only searches the table after a larger jump, which makes the lookup O(1) amortized for
+*  a slowly varying signal.
+*/
+int32_t ConvertADCReadingToPressureTracked(uint16_t adcReading, PressureTracker* trackerPtr) {
+    const PressureTable* t = trackerPtr->table;
+    const PressureTableEntry* entries = t->entries;
+    int16_t segment;
+
+    if (t->lut != NULL) {
+        return t->lut[adcReading];
+    }
+    if ((adcReading < entries[0].adc) || (adcReading > entries[t->tableSize].adc)) {
+        return (int32_t)(t->fit.slope * adcReading + t->fit.intercept);
+    }
+    if (adcReading == entries[t->tableSize].adc) {
+        return entries[t->tableSize].pressure;
+    }
+    segment = TrackSegment(t, trackerPtr->segment, adcReading PRESSURE_STATS_ARG(NULL));
+    if ((segment >= (trackerPtr->segment - 1)) && (segment <= (trackerPtr->segment + 1))) {
+        trackerPtr->hits++;
+    }
+    else {
+        trackerPtr->misses++;
+    }
+    trackerPtr->segment = segment;
+    return InterpolateSegment(entries, t->slopes, t->pressureStep, segment, adcReading);
+}
+
+/* This function decimates the oversampled ADC readings and converts them in a single pass, e.g. over a DMA
+*  buffer of 16x oversampled readings (decimationShift = 4). Every output is converted from the sum of
+*  2^decimationShift consecutive readings (a boxcar, i.e. a first-order CIC filter), and the fractional bits
+*  that the sum holds beyond the average are kept through the segment search and the interpolation rather
+*  than rounded away. The buffer holds outCount << decimationShift readings, with decimationShift of 0 to 16.
+*  Like ConvertADCBufferToPressure(...), the segment of the previous output is checked first. The results
+*  are the interpolation of the table at the exact average, rounded; with decimationShift = 0 and the segment
+*  slopes, they are the same as those of ConvertADCBufferToPressure(...).
+*/
+void ConvertADCBufferToPressureDecimated(const uint16_t* in, int32_t* out, size_t outCount, uint8_t decimationShift, const PressureTable* t) {
+    const PressureTableEntry* entries = t->entries;
+    const int16_t tableSize = t->tableSize;
+    const uint32_t minADCSum = (uint32_t)entries[0].adc << decimationShift;
+    const uint32_t maxADCSum = (uint32_t)entries[tableSize].adc << decimationShift;
+    const size_t decimation = (size_t)1 << decimationShift;
+    const int64_t rounding = ((int64_t)1 << decimationShift) >> 1;
+    int16_t segment = 0;
+
+    for (size_t i = 0; i < outCount; i++) {
+        const uint16_t* samples = &in[i << decimationShift];
+        uint32_t adcReadingSum = 0;
+
+        for (size_t k = 0; k < decimation; k++) {
+            adcReadingSum += samples[k];
+        }
+        if ((adcReadingSum < minADCSum) || (adcReadingSum > maxADCSum)) {
+            out[i] = (int32_t)((t->fit.slope * adcReadingSum + t->fit.intercept * ((int64_t)1 << decimationShift) + rounding) >> decimationShift);
+        }
+        else if (adcReadingSum == maxADCSum) {
+            out[i] = entries[tableSize].pressure;
+        }
+        else {
+            // The segment is that of the integer part of the average.
+            segment = TrackSegment(t, segment, (uint16_t)(adcReadingSum >> decimationShift) PRESSURE_STATS_ARG(NULL));
+            out[i] = InterpolateSegmentFraction(entries, t->slopes, t->pressureStep, segment, adcReadingSum, decimationShift);
+        }
+    }
+}
+
+/* Converts an ADC reading with fractionBits fractional bits (0 to PRESSURE_SLOPE_SHIFT) into a pressure
+*  with PRESSURE_SLOPE_SHIFT fractional bits, checking the given segment first and updating it.
+*/
+static int64_t PressureQ16(const PressureTable* t, int16_t* segmentPtr, uint32_t adcReading, uint8_t fractionBits) {
+    const PressureTableEntry* entries = t->entries;
+    int64_t pressure;
+
+    if ((adcReading < ((uint32_t)entries[0].adc << fractionBits)) || (adcReading > ((uint32_t)entries[t->tableSize].adc << fractionBits))) {
+        // The extrapolation is exact in Q16, since the fit has whole slope and intercept.
+        pressure = (t->fit.slope * adcReading + t->fit.intercept * ((int64_t)1 << fractionBits)) * ((int64_t)1 << (PRESSURE_SLOPE_SHIFT - fractionBits));
+    }
+    else if (adcReading == ((uint32_t)entries[t->tableSize].adc << fractionBits)) {
+        pressure = (int64_t)entries[t->tableSize].pressure * (1L << PRESSURE_SLOPE_SHIFT);
+    }
+    else {
+        *segmentPtr = TrackSegment(t, *segmentPtr, (uint16_t)(adcReading >> fractionBits) PRESSURE_STATS_ARG(NULL));
+        pressure = InterpolateSegmentQ16(entries, t->slopes, t->pressureStep, *segmentPtr, adcReading, fractionBits);
+    }
+    return pressure;
+}
+
+/* Scales a Q16 pressure in 0.01 KPa into the output unit with the Q16 output scale, rounded, and saturated
+*  to the 32 bit range. The whole and fractional parts of the pressure are multiplied separately, with the
+*  same result as (pressure * outputScale + 2^31) >> 32 when that product fits in 64 bits. Beyond, i.e. for
+*  at least 2^31 whole units with a scale of at least 2^16, the output is saturated without multiplying:
+*  otherwise, a fitted extrapolation near the 16 bit rails could overflow with up to 1000000 units per KPa.
+*/
+static int32_t ScalePressureQ16(int64_t pressure, uint32_t outputScale) {
+    const int64_t whole = pressure >> PRESSURE_SLOPE_SHIFT;
+    const uint64_t fraction = (uint64_t)pressure & ((1UL << PRESSURE_SLOPE_SHIFT) - 1);
+    int64_t scaled;
+
+    if (((whole >= ((int64_t)1 << 31)) || (whole < -((int64_t)1 << 31))) && (outputScale >= (1UL << PRESSURE_SLOPE_SHIFT))) {
+        return (whole < 0) ? INT32_MIN : INT32_MAX;
+    }
+    scaled = whole * outputScale + (int64_t)((fraction * outputScale + (1ULL << (2 * PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+    scaled >>= PRESSURE_SLOPE_SHIFT;
+    if (scaled > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (scaled < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return (int32_t)scaled;
+}
+
+/* Converts an ADC reading in the given Q format, checking the given segment first and updating it. */
+static int32_t ConvertQ(const PressureTable* t, const PressureQFormat* formatPtr, int16_t* segmentPtr, uint32_t adcReading) {
+    uint8_t fractionBits = formatPtr->inputFractionBits;
+    int64_t pressure;
+
+    // The interpolation keeps at most as many fractional bits as the slopes, so the extra ones of the
+    // reading are dropped rather than shifting by a negative amount.
+    if (fractionBits > PRESSURE_SLOPE_SHIFT) {
+        adcReading = ((fractionBits - PRESSURE_SLOPE_SHIFT) < 32) ? (adcReading >> (fractionBits - PRESSURE_SLOPE_SHIFT)) : 0;
+        fractionBits = PRESSURE_SLOPE_SHIFT;
+    }
+    pressure = PressureQ16(t, segmentPtr, adcReading, fractionBits);
+
+    // Scaled from 0.01 KPa to the output unit, both factors having 16 fractional bits.
+    return ScalePressureQ16(pressure, formatPtr->outputScale);
+}
+
+/* This function converts an ADC reading with inputFractionBits fractional bits (e.g. from a digital
+*  filter) into a pressure reading in the output unit of the format, e.g. Pa or Q8 KPa. The pressure is
+*  interpolated with the Q16 segment slopes at the exact fractional reading, and kept with 16 fractional
+*  bits until it is scaled to the output unit and rounded, so no precision is lost to an early division
+*  or rounding. With the slopes, there is no division at run-time at all.
+*/
+int32_t ConvertADCReadingToPressureQ(uint32_t adcReading, const PressureTable* tablePtr, const PressureQFormat* formatPtr) {
+    int16_t segment = 0;
+    return ConvertQ(tablePtr, formatPtr, &segment, adcReading);
+}
+
+/* This function converts a buffer of ADC readings in the given Q format, with the same results as
+*  ConvertADCReadingToPressureQ(...), checking the segment of the previous reading first.
+*/
+void ConvertADCBufferToPressureQ(const uint32_t* in, int32_t* out, size_t n, const PressureTable* t, const PressureQFormat* formatPtr) {
+    int16_t segment = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ConvertQ(t, formatPtr, &segment, in[i]);
+    }
+}
+
+/* Selects the temperature bin of the surface that contains the temperature, [temperatures[row],
+*  temperatures[row + 1]), with the first bin extended below the first row and the last row as its own
+*  bin above, and updates the blend weight. The temperature usually only moves within its bin or to a
+*  neighbouring one, so the rows are searched from the current one, and the division for the reciprocal
+*  of the bin width is only done when another bin is entered.
+*/
+static void UpdateSurfaceTemperature(PressureSurfaceState* statePtr, int16_t temperature) {
+    const PressureSurface* surfacePtr = statePtr->surface;
+    const int16_t* temperatures = surfacePtr->temperatures;
+    uint8_t row = statePtr->row;
+
+    while ((row > 0) && (temperature < temperatures[row])) {
+        row--;
+    }
+    while (((row + 1) < surfacePtr->rowCount) && (temperature >= temperatures[row + 1])) {
+        row++;
+    }
+    if (row != statePtr->row) {
+        // The segment of a table is only kept if it remains active, since the tables may differ in length.
+        int16_t lowerSegment = statePtr->segments[0];
+        int16_t upperSegment = statePtr->segments[1];
+        statePtr->segments[0] = (row == (statePtr->row + 1)) ? upperSegment : 0;
+        statePtr->segments[1] = ((row + 1) == statePtr->row) ? lowerSegment : 0;
+        statePtr->row = row;
+        if ((row + 1) < surfacePtr->rowCount) {
+            statePtr->binScale = (uint32_t)((1UL << 31) / (uint32_t)(temperatures[row + 1] - temperatures[row]));
+        }
+    }
+    statePtr->temperature = temperature;
+    statePtr->spanStart = 0;
+    statePtr->spanEnd = 0;
+
+    if (((row + 1) >= surfacePtr->rowCount) || (temperature <= temperatures[row])) {
+        statePtr->upperWeight = 0;
+    }
+    else {
+        // Below 2^31 / 2^16 = 2^15, as the temperature is below the upper row.
+        statePtr->upperWeight = (uint16_t)(((uint32_t)(temperature - temperatures[row]) * statePtr->binScale) >> 16);
+    }
+}
+
+/* This function initializes the conversion state of a temperature-compensated calibration surface, for
+*  the given initial temperature reading. The rows must be sorted by strictly increasing temperature.
+*  Returns -1 if the surface has no rows, and 0 otherwise.
+*/
+int16_t PressureSurface_Init(PressureSurfaceState* statePtr, const PressureSurface* surfacePtr, int16_t temperature) {
+    if (surfacePtr->rowCount == 0) {
+        return -1;
+    }
+    statePtr->surface = surfacePtr;
+    statePtr->row = 0;
+    statePtr->binScale = (surfacePtr->rowCount > 1) ? (uint32_t)((1UL << 31) / (uint32_t)(surfacePtr->temperatures[1] - surfacePtr->temperatures[0])) : 0;
+    statePtr->segments[0] = 0;
+    statePtr->segments[1] = 0;
+    UpdateSurfaceTemperature(statePtr, temperature);
+    return 0;
+}
+
+/* This function updates the temperature of the conversion state, for the following ...Surface(...)
+*  conversions. Within the current temperature bin, only the blend weight is updated, with a single
+*  multiplication.
+*/
+void PressureSurface_SetTemperature(PressureSurfaceState* statePtr, int16_t temperature) {
+    if (temperature != statePtr->temperature) {
+        UpdateSurfaceTemperature(statePtr, temperature);
+    }
+}
+
+/* Converts an ADC reading at the temperature of the state, within the cached span of readings if it
+*  falls in it. Otherwise, when the reading is in range of the tables with the segment slopes, the span is
+*  updated to the overlap of the segments of the reading in both tables, on which the blend of the tables
+*  is a single line, and the reading is converted with it. Outside of the span, the pressures of the
+*  tables are blended on their own.
+*/
+static int32_t ConvertSurface(PressureSurfaceState* statePtr, uint16_t adcReading) {
+    const PressureTable* rows = &statePtr->surface->rows[statePtr->row];
+    const uint16_t upperWeight = statePtr->upperWeight;
+    int64_t pressure;
+
+    if ((adcReading < statePtr->spanStart) || (adcReading >= statePtr->spanEnd)) {
+        const int16_t rowsBlended = (upperWeight != 0) ? 2 : 1;
+        int16_t r;
+
+        statePtr->spanStart = 0;
+        statePtr->spanEnd = 0;
+        for (r = 0; r < rowsBlended; r++) {
+            if ((rows[r].slopes == NULL) || (adcReading < rows[r].entries[0].adc) || (adcReading >= rows[r].entries[rows[r].tableSize].adc)) {
+                break;
+            }
+        }
+
+        if (r < rowsBlended) {
+            pressure = PressureQ16(&rows[0], &statePtr->segments[0], adcReading, 0);
+            if (upperWeight != 0) {
+                int64_t upperPressure = PressureQ16(&rows[1], &statePtr->segments[1], adcReading, 0);
+                pressure += ((upperPressure - pressure) * upperWeight) >> 15;
+            }
+            return (int32_t)((pressure + (1L << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+        }
+
+        for (r = 0; r < rowsBlended; r++) {
+            const PressureTableEntry* entries = rows[r].entries;
+            int16_t segment = TrackSegment(&rows[r], statePtr->segments[r], adcReading PRESSURE_STATS_ARG(NULL));
+
+            statePtr->segments[r] = segment;
+            if ((r == 0) || (entries[segment].adc > statePtr->spanStart)) {
+                statePtr->spanStart = entries[segment].adc;
+            }
+            if ((r == 0) || (entries[segment + 1].adc < statePtr->spanEnd)) {
+                statePtr->spanEnd = entries[segment + 1].adc;
+            }
+        }
+        statePtr->spanPressure = InterpolateSegmentQ16(rows[0].entries, rows[0].slopes, rows[0].pressureStep, statePtr->segments[0], statePtr->spanStart, 0);
+        statePtr->spanSlope = rows[0].slopes[statePtr->segments[0]];
+        if (upperWeight != 0) {
+            int64_t upperPressure = InterpolateSegmentQ16(rows[1].entries, rows[1].slopes, rows[1].pressureStep, statePtr->segments[1], statePtr->spanStart, 0);
+            int32_t upperSlope = rows[1].slopes[statePtr->segments[1]];
+            statePtr->spanPressure += ((upperPressure - statePtr->spanPressure) * upperWeight) >> 15;
+            statePtr->spanSlope += (int32_t)(((int64_t)(upperSlope - statePtr->spanSlope) * upperWeight) >> 15);
+        }
+    }
+    pressure = statePtr->spanPressure + (int64_t)statePtr->spanSlope * (adcReading - statePtr->spanStart);
+    return (int32_t)((pressure + (1L << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+}
+
+/* This function converts an ADC reading into a pressure reading at the temperature of the conversion
+*  state (see PressureSurface_SetTemperature(...)), interpolated bilinearly in the calibration surface.
+*  The pressures of both tables are kept with 16 fractional bits until they are blended, so at the
+*  calibration temperatures, the result is the same as ConvertADCReadingToPressure(...) with the table of
+*  that temperature (for tables with Q16 slopes). The span of readings on which the blend is a single line
+*  is cached in the state, so a following reading in the same span costs about as much as with a 1D table.
+*/
+int32_t ConvertADCReadingToPressureSurface(uint16_t adcReading, PressureSurfaceState* statePtr) {
+    return ConvertSurface(statePtr, adcReading);
+}
+
+/* This function converts a buffer of ADC readings, all at the temperature of the conversion state, with
+*  the same results as ConvertADCReadingToPressureSurface(...).
+*/
+void ConvertADCBufferToPressureSurface(const uint16_t* in, int32_t* out, size_t n, PressureSurfaceState* statePtr) {
+    // Kept in registers for the loop, as the stores to the output could otherwise alias it.
+    PressureSurfaceState state = *statePtr;
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ConvertSurface(&state, in[i]);
+    }
+    *statePtr = state;
+}
+
+/* Pressure of entry i of the compact table: a point of the regular grid, plus its residual when provided. */
+static int32_t CompactPressure(const PressureCompactTable* t, int16_t i) {
+    int32_t pressure = t->basePressure + t->pressureStep * i;
+
+    if (t->pressureResiduals != NULL) {
+        pressure += t->pressureResiduals[i];
+    }
+    return pressure;
+}
+
+/* Same as FindSegment(...), over the ADC readings of a compact table. */
+static int16_t FindCompactSegment(const uint16_t* adc, int16_t tableSize, uint16_t adcReading) {
+    int16_t searchWindowStart = 0;
+    int16_t searchWindowEnd = tableSize;
+
+    while ((searchWindowEnd - searchWindowStart) > 1) {
+        int16_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+        if (adcReading < adc[midPoint]) {
+            searchWindowEnd = midPoint;
+        }
+        else {
+            searchWindowStart = midPoint;
+        }
+    }
+    return searchWindowStart;
+}
+
+/* Finds the segment of a compact table containing the ADC reading, through the direct segment index
+*  when provided, or the binary search otherwise. The caller must ensure that adc[0] <= adcReading <
+*  adc[tableSize].
+*/
+static int16_t SearchCompactSegment(const PressureCompactTable* t, uint16_t adcReading) {
+    if (t->index != NULL) {
+        int16_t segment = t->index->segments[(adcReading >> PRESSURE_INDEX_SHIFT) - t->index->firstBucket];
+
+        while (adcReading >= t->adc[segment + 1]) {
+            segment++;
+        }
+        return segment;
+    }
+    return FindCompactSegment(t->adc, t->tableSize, adcReading);
+}
+
+/* Same as TrackSegment(...), over the ADC readings of a compact table: the given segment and its
+*  neighbours are checked before searching. The caller must ensure that adc[0] <= adcReading <
+*  adc[tableSize].
+*/
+static int16_t TrackCompactSegment(const PressureCompactTable* t, int16_t segment, uint16_t adcReading) {
+    const uint16_t* adc = t->adc;
+
+    if (adcReading < adc[segment]) {
+        if (adcReading >= adc[segment - 1]) {
+            return segment - 1;
+        }
+    }
+    else if (adcReading < adc[segment + 1]) {
+        return segment;
+    }
+    else if (adcReading < adc[segment + 2]) {
+        return segment + 1;
+    }
+    return SearchCompactSegment(t, adcReading);
+}
+
+/* Same as InterpolateSegment(...), with the pressures of a compact table. With evenly spaced pressures, 
+*  P2 - P1 is the grid step, so only P1 is computed.
+*/
+static int32_t InterpolateCompactSegment(const PressureCompactTable* t, int16_t segment, uint16_t adcReading) {
+    int32_t P1 = CompactPressure(t, segment);
+    uint16_t ADC1 = t->adc[segment];
+
+    if (t->slopes != NULL) {
+        int32_t offset = t->slopes[segment] * (int32_t)(adcReading - ADC1);
+        return P1 + ((offset + (1L << (PRESSURE_SLOPE_SHIFT - 1))) >> PRESSURE_SLOPE_SHIFT);
+    }
+    else {
+        int32_t P2 = (t->pressureResiduals != NULL) ? CompactPressure(t, segment + 1) : (P1 + t->pressureStep);
+        uint16_t ADC2 = t->adc[segment + 1];
+        return P1 + ((P2 - P1) / (ADC2 - ADC1)) * (adcReading - ADC1);
+    }
+}
+
+/* This function converts an ADC reading with the compact form of a table (see PressureCompactTable_Init(...)),
+*  giving the same pressure reading as ConvertADCReadingToPressure(...) with the original table. The 
+*  search only reads the 2 byte ADC readings, so the 91 readings of pressureTable span 3 cache lines
+*  rather than 12.
+*/
+int ConvertADCReadingToPressureCompact(int adcReading, const PressureCompactTable* tablePtr) {
+    const int16_t tableSize = tablePtr->tableSize;
+
+    if ((adcReading < tablePtr->adc[0]) || (adcReading > tablePtr->adc[tableSize])) {
+        return tablePtr->fit.slope * adcReading + tablePtr->fit.intercept;
+    }
+    if (adcReading == tablePtr->adc[tableSize]) {
+        return CompactPressure(tablePtr, tableSize);
+    }
+    return InterpolateCompactSegment(tablePtr, SearchCompactSegment(tablePtr, (uint16_t)adcReading), (uint16_t)adcReading);
+}
+
+/* This function converts a buffer of ADC readings with the compact form of a table, giving the same
+*  results as ConvertADCBufferToPressure(...) with the original table, and the same reuse of the segment
+*  of the previous sample and its neighbours, so a slowly varying signal is converted without searching.
+*/
+void ConvertADCBufferToPressureCompact(const uint16_t* in, int32_t* out, size_t n, const PressureCompactTable* t) {
+    const uint16_t* adc = t->adc;
+    const int16_t tableSize = t->tableSize;
+    const uint16_t minADC = adc[0];
+    const uint16_t maxADC = adc[tableSize];
+    const int32_t maxPressure = CompactPressure(t, tableSize);
+    const int64_t slope = t->fit.slope;
+    const int64_t intercept = t->fit.intercept;
+    int16_t segment = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t adcReading = in[i];
+
+        if ((adcReading < minADC) || (adcReading > maxADC)) {
+            out[i] = slope * adcReading + intercept;
+        }
+        else if (adcReading == maxADC) {
+            out[i] = maxPressure;
+        }
+        else {
+            // Only search the table when the reading left the segment of the previous sample and its neighbours.
+            segment = TrackCompactSegment(t, segment, adcReading);
+            out[i] = InterpolateCompactSegment(t, segment, adcReading);
+        }
+    }
+}
@@ -0,0 +1,393 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Type definitions and function prototypes shared by the conversion functions, the offline table
+*   generator and the generated Pressure-ADC tables (see pressure_table.h).
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_SENSOR_H
+#define PRESSURE_SENSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pressure values are multiplied by FIXED_POINT_ARITH to achieve 0.01 KPa precision without floating point.
+#define FIXED_POINT_ARITH 100
+// Number of low ADC bits ignored by the direct segment index. With the smallest ADC step in pressureTable
+// being 31, a bucket of 64 readings spans at most 3 segments.
+#define PRESSURE_INDEX_SHIFT 6
+// Number of fractional bits of the precomputed segment slopes. The slope of a segment is only stored if
+// its pressure step fits in 15 bits, so that slope * (ADC - ADC1) never overflows a 32 bit int.
+#define PRESSURE_SLOPE_SHIFT 16
+// Number of entries in the direct segment index of a table spanning [minADC, maxADC].
+#define PRESSURE_INDEX_BUCKETS(minADC, maxADC) ((uint16_t)(((maxADC) >> PRESSURE_INDEX_SHIFT) - ((minADC) >> PRESSURE_INDEX_SHIFT) + 1))
+// Initializer of one table entry, for the X-macro lists of entries of the generated tables, e.g.
+//   static const PressureTableEntry pressureTable[] = { PRESSURE_TABLE_ENTRIES(PRESSURE_TABLE_ENTRY) };
+#define PRESSURE_TABLE_ENTRY(pressure, adc) { (pressure), (adc) },
+// Upper bound on the number of key slots of the Eytzinger layout of a table, for sizing its arrays.
+#define PRESSURE_EYTZINGER_SLOTS(tableSize) (2 * ((tableSize) + 1))
+
+/* Attributes for the generated tables, which are compile-time constants meant to be stored in Flash
+*  memory. With GCC on non position-independent ELF targets (e.g. Cortex-M), the tables are placed in 
+*  their own read-only section so that the linker script can locate them. Position-independent (desktop)
+*  builds leave the placement to the compiler, since the descriptors hold relocated pointers. A generated
+*  header is not required to be used entirely by every translation unit that includes it, hence the 
+*  unused attribute. On AVR, Flash memory is a separate address space, so the tables are placed in program
+*  memory, and are converted by the ...AVR(...) functions (see pressure_avr.c), which read them with
+*  pgm_read_*. The other conversion functions read their descriptor as RAM, so the generated header makes
+*  them a compile error on AVR (PRESSURE_FLASH_IN_PROGRAM_MEMORY), unless PRESSURE_ALLOW_RAM_CONVERSIONS is
+*  defined for a translation unit that also converts with tables built in RAM. Define PRESSURE_FLASH_DATA
+*  before including the generated header to override this.
+*/
+#ifndef PRESSURE_FLASH_DATA
+#if defined(__GNUC__) && defined(__AVR__)
+#define PRESSURE_FLASH_DATA __attribute__((progmem, unused))
+#define PRESSURE_FLASH_IN_PROGRAM_MEMORY 1
+#elif defined(__GNUC__) && defined(__ELF__) && !defined(__PIC__)
+#define PRESSURE_FLASH_DATA __attribute__((section(".rodata.pressure_table"), unused))
+#elif defined(__GNUC__)
+#define PRESSURE_FLASH_DATA __attribute__((unused))
+#else
+#define PRESSURE_FLASH_DATA
+#endif
+#endif
+
+// Variable definitions that, in the microcontroller environment, would be stored in
+// Flash memory to limit RAM usage.
+typedef struct {
+    // Pressure is multiplied by FIXED_POINT_ARITH to avoid floating point. Using a 32 bit int for this to
+    // prevent bit overflow with the nominal 16 bit int in the microcontroller. Directly specifying this rather
+    // than long for easier readibility.
+    int32_t pressure;
+    uint16_t adc;
+} PressureTableEntry;
+
+// Linear fit (P = slope * ADC + intercept) of the whole Pressure-ADC table, used for extrapolation when
+// a reading falls outside of the table bounds. Both values are scaled by FIXED_POINT_ARITH, like the
+// pressures in the table. Computing the fit requires 64-bit integers, so it is done once by
+// PressureFit_Init(...) rather than on every out-of-range reading.
+typedef struct {
+    int64_t slope;
+    int64_t intercept;
+} PressureFit;
+
+// Running sums of an incremental least-squares fit (see PressureFitAccumulator_Init(...)), e.g. for
+// reference points appended during a field calibration session. The sums use the same scaling as
+// PressureFit_Init(...), and the fit is cached until a point is added or removed.
+typedef struct {
+    int64_t sumOfADC_iTimesP_i;
+    int64_t sumOfADC_i;
+    int64_t sumOfP_i;
+    int64_t sumOfADC_iSquared;
+    int32_t pointCount;
+    PressureFit fit;
+    int16_t fitIsValid;
+} PressureFitAccumulator;
+
+// Direct segment index of a Pressure-ADC table. Entry (adcReading >> PRESSURE_INDEX_SHIFT) - firstBucket
+// holds the first table segment that can contain the ADC reading, which replaces the binary search with
+// a single load followed by at most a couple of linear steps. Like the table, it is meant to be stored
+// in Flash memory.
+typedef struct {
+    const uint8_t* segments;
+    uint16_t firstBucket;
+    uint16_t bucketCount;
+} PressureIndex;
+
+// Eytzinger (breadth-first) layout of the ADC readings of a Pressure-ADC table, for tables too large for
+// the direct segment index. The readings are stored on their own (rather than in the 8 byte table
+// entries) as a complete binary search tree padded with UINT16_MAX: slot k has its children in slots
+// 2k and 2k + 1, and slot 0 is unused. The search then descends exactly depth levels without a branch,
+// and the descendants of a slot a few levels down are contiguous, so they can be prefetched in advance.
+// ranks[k] is the index in the table of the entry whose reading is held by slot k.
+typedef struct {
+    const uint16_t* keys;
+    const uint16_t* ranks;
+    uint8_t depth;
+} PressureEytzinger;
+
+// Descriptor bundling a Pressure-ADC table with the data that is precomputed from it, so that the
+// conversion functions do not have to rederive anything on a per reading basis. Every sensor channel
+// has its own descriptor, either generated into Flash memory (see pressure_table.h) or filled in at
+// start-up by PressureTable_Init(...) for a table calibrated at run-time.
+typedef struct {
+    const PressureTableEntry* entries;
+    // Index of the last entry in the table (i.e. the number of entries minus one).
+    int16_t tableSize;
+    PressureFit fit;
+    // Optional direct segment index, NULL to use the binary search.
+    const PressureIndex* index;
+    // Optional Q16 fixed-point slope of every segment, NULL to divide on every interpolation.
+    const int32_t* slopes;
+    // Optional Eytzinger layout of the ADC readings, used instead of the binary search when there is no
+    // direct segment index. Left NULL by PressureTable_Init(...).
+    const PressureEytzinger* eytzinger;
+    // Pressure step between consecutive entries when it is the same for the whole table (e.g. 1000 for
+    // pressureTable), 0 otherwise. The pressure of entry i is then entries[0].pressure + pressureStep * i,
+    // so the interpolation does not load the pressure column.
+    int32_t pressureStep;
+    // Optional dense table of the pressure of every 16 bit ADC reading (PRESSURE_LUT_SIZE values, 256 KB),
+    // for hosts with memory to spare. When set, every conversion is a single load from it. Left NULL by
+    // PressureTable_Init(...), and filled in by PressureTable_InitLUT(...).
+    const int32_t* lut;
+} PressureTable;
+
+// Number of values of the dense table of a descriptor, one per 16 bit ADC reading.
+#define PRESSURE_LUT_SIZE ((uint32_t)UINT16_MAX + 1)
+
+// Fixed-point formats of the ...Q(...) conversion functions. The ADC readings have inputFractionBits
+// fractional bits (0 to 16, e.g. 8 for Q8 readings from a digital filter), and the pressure readings are
+// given in output units, of which there are outputScale / 2^16 per 0.01 KPa (see PRESSURE_OUTPUT_SCALE).
+// The readings of a format with more than 16 fractional bits are converted with their 16 most significant
+// fractional bits; PRESSURE_Q_FORMAT(...) rejects such a format at compile time.
+typedef struct {
+    uint8_t inputFractionBits;
+    uint32_t outputScale;
+} PressureQFormat;
+
+// Output scale of a PressureQFormat for the given number of output units per KPa, computed at compile
+// time, e.g. PRESSURE_OUTPUT_SCALE(FIXED_POINT_ARITH) for 0.01 KPa, PRESSURE_OUTPUT_SCALE(1000) for Pa, or
+// PRESSURE_OUTPUT_SCALE(256) for KPa with 8 fractional bits. Up to 1000000 output units per KPa are supported,
+// and the pressure readings beyond 32 bits saturate.
+#define PRESSURE_OUTPUT_SCALE(unitsPerKPa) ((uint32_t)((((uint64_t)(unitsPerKPa) << 16) + FIXED_POINT_ARITH / 2) / FIXED_POINT_ARITH))
+
+// Initializer of a PressureQFormat, e.g. "static const PressureQFormat format = PRESSURE_Q_FORMAT(8, 1000);"
+// for Q8 readings and Pa. A format with more than 16 input fractional bits, or more than 1000000 output
+// units per KPa, does not compile.
+#define PRESSURE_Q_FORMAT(inputFractionBits, unitsPerKPa) \
+    { (uint8_t)((inputFractionBits) + 0 * sizeof(char[(((inputFractionBits) <= PRESSURE_SLOPE_SHIFT) && ((unitsPerKPa) <= 1000000)) ? 1 : -1])), \
+      PRESSURE_OUTPUT_SCALE(unitsPerKPa) }
+
+// Conversion context of one sensor channel, for ConvertADCReadingToPressureTracked(...). It remembers the
+// segment of the last reading, so that a slowly varying signal is converted without searching the table,
+// and counts the readings within the table bounds that were found in that segment or a neighbouring one
+// (hits) or that needed a search (misses). The hit rate is hits / (hits + misses).
+typedef struct {
+    const PressureTable* table;
+    int16_t segment;
+    uint32_t hits;
+    uint32_t misses;
+} PressureTracker;
+
+// Temperature-compensated calibration: one Pressure-ADC table per calibration temperature, in rows of
+// strictly increasing temperature (in the unit of the temperature sensor, e.g. 0.01 degC). The pressure
+// is interpolated bilinearly, along the ADC reading in the two tables around the temperature, and then
+// along the temperature between them. Below the first and above the last temperature, the nearest table
+// is used on its own.
+typedef struct {
+    const PressureTable* rows;
+    const int16_t* temperatures;
+    uint8_t rowCount;
+} PressureSurface;
+
+// Conversion state of a PressureSurface, caching the rows around the last temperature reading, their
+// blend weight and their last segments, so that a new temperature costs a multiplication within the
+// current temperature bin, and a division only when it crosses into another one. For the tables with
+// segment slopes, it also caches the span of ADC readings [spanStart, spanEnd) on which the blend of the
+// active segments of both rows is a single line, given by its Q16 pressure at spanStart and Q16 slope.
+typedef struct {
+    const PressureSurface* surface;
+    int16_t temperature;
+    // The pressure is blended between rows row and row + 1, with a Q15 weight of the upper row, which
+    // is 0 at and outside the outer calibration temperatures.
+    uint8_t row;
+    uint16_t upperWeight;
+    // 2^31 divided by the width of the temperature bin, computed when it is entered.
+    uint32_t binScale;
+    int16_t segments[2];
+    uint16_t spanStart;
+    uint16_t spanEnd;
+    int32_t spanSlope;
+    int64_t spanPressure;
+} PressureSurfaceState;
+
+// Piecewise-polynomial form of a Pressure-ADC table (see pressure_poly.c), for high-resolution calibrations
+// that are too large to store in full. [minADC, maxADC] is split into segmentCount segments of any length,
+// placed by the fitter only where a longer polynomial would exceed the error bound, so a smooth calibration
+// needs a handful of them. segmentStarts holds the first ADC reading of every segment (segmentStarts[0] is
+// minADC), and segmentShifts the base 2 logarithm of a power of two at least as large as the length of the
+// segment. Within a segment, the pressure is a polynomial of the position t = (ADC - start) / 2^shift of the
+// reading (0 <= t < 1, as a Q16 value), with degree + 1 coefficients (constant term first) scaled by
+// 2^PRESSURE_POLY_COEFFICIENT_SHIFT. The coefficients are fitted offline by the table generator, which
+// guarantees the maximum error from the table for every reading.
+#define PRESSURE_POLY_COEFFICIENT_SHIFT 8
+#define PRESSURE_POLY_MAX_DEGREE 3
+typedef struct {
+    const int32_t* coefficients;
+    const uint16_t* segmentStarts;
+    const uint8_t* segmentShifts;
+    uint16_t minADC;
+    uint16_t maxADC;
+    uint16_t segmentCount;
+    uint8_t degree;
+    PressureFit fit;
+} PressurePolyTable;
+
+// Double-buffered table descriptor, for a calibration that is replaced while the conversion functions
+// are running (see pressure_table_slot.c). The lowest bit of the generation selects the active descriptor,
+// so switching tables is a single byte store, which is atomic on any microcontroller.
+typedef struct {
+    PressureTable tables[2];
+    volatile uint8_t generation;
+} PressureTableSlot;
+
+// Packed format of pressure readings, for buffers that cannot afford 32 bits per reading (see pressure_ring.c).
+// A reading is stored as (pressure - offset) >> shift, saturated to the width: unsigned in 16 bits, or
+// signed and little-endian in 24 bits. For pressureTable (100 to 1000 KPa), an offset of 10000 and a
+// shift of 1 keep a 0.02 KPa resolution in 16 bits, and 24 bits hold the readings unchanged.
+typedef enum {
+    PRESSURE_PACKED_16,
+    PRESSURE_PACKED_24
+} PressurePackedWidth;
+
+typedef struct {
+    PressurePackedWidth width;
+    int32_t offset;
+    uint8_t shift;
+} PressurePackedFormat;
+
+// Ring of packed pressure readings converted from the circular DMA buffer of the ADC (see pressure_ring.c),
+// made of two halves of halfLength readings. The DMA half-complete and complete callbacks convert their
+// half and advance head, and the consumer reads the converted halves in order and advances tail. Both
+// are free-running counts of halves, so the readings pending are head - tail.
+typedef struct {
+    const PressureTable* table;
+    const uint16_t* adc;
+    // Packed pressures, which may be the ADC buffer itself in 16 bits.
+    uint8_t* pressures;
+    uint16_t halfLength;
+    PressurePackedFormat format;
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    // Half of the DMA buffer (0 or 1) converted for each of the last two heads, indexed by the lowest bit
+    // of the head count before it was advanced, so that the consumer does not rely on the callbacks
+    // alternating from the first half.
+    volatile uint8_t halves[2];
+    // Halves overwritten before the consumer acquired them.
+    uint16_t overruns;
+} PressureRing;
+
+// Compact form of a Pressure-ADC table, for sensors whose calibration pressures are (nearly) evenly
+// spaced. The ADC readings are stored on their own, 2 bytes per entry instead of the 8 bytes of a padded
+// PressureTableEntry, and the pressure of entry i is computed as basePressure + pressureStep * i, plus
+// an optional 16 bit residual for the entries that are off the regular grid. Like the table, it is
+// meant to be stored in Flash memory, and is converted by the ...Compact(...) conversion functions.
+typedef struct {
+    const uint16_t* adc;
+    // Optional residual of every pressure from the regular grid, NULL when the pressures are exactly evenly spaced.
+    const int16_t* pressureResiduals;
+    int32_t basePressure;
+    int32_t pressureStep;
+    // Index of the last entry in the table (i.e. the number of entries minus one).
+    int16_t tableSize;
+    PressureFit fit;
+    // Optional direct segment index and Q16 segment slopes, as in PressureTable.
+    const PressureIndex* index;
+    const int32_t* slopes;
+} PressureCompactTable;
+
+#if defined(PRESSURE_INSTRUMENTATION)
+// Number of bins of the search depth histogram. The last bin also counts the deeper searches.
+#define PRESSURE_STATS_DEPTH_BINS 16
+
+// Counters of ConvertADCReadingToPressure(...) and ConvertADCBufferToPressure(...), only compiled in
+// when building with -DPRESSURE_INSTRUMENTATION. They are updated in place in the global pressureStats,
+// so a debugger can poll them at a fixed address without involving the firmware. The cycles are measured
+// with PRESSURE_STATS_CYCLES(), which defaults to the time-stamp counter on x86 and otherwise has to be
+// defined for the target (e.g. -D'PRESSURE_STATS_CYCLES()=DWT->CYCCNT' on a Cortex-M3/M4/M7).
+typedef struct {
+    // Readings converted by every path: the pressure of an entry without interpolation (first or last
+    // entry, or an exact match of the binary search), an interpolation, an extrapolation, or a load
+    // from the dense table.
+    uint32_t exactHits;
+    uint32_t interpolations;
+    uint32_t extrapolations;
+    uint32_t lutHits;
+    // Readings of the batch API within the segment of the previous sample or a neighbouring one, i.e.
+    // without any search.
+    uint32_t segmentReuses;
+    // Number of searches by their number of steps: iterations of the binary search, linear steps after
+    // the direct segment index, or levels of the Eytzinger layout.
+    uint32_t searchDepth[PRESSURE_STATS_DEPTH_BINS];
+    // Runs of consecutive readings out of the table bounds, the longest one and the current one.
+    uint32_t outOfRangeRuns;
+    uint32_t longestOutOfRangeRun;
+    uint32_t currentOutOfRangeRun;
+    // Fewest and most cycles of a ConvertADCReadingToPressure(...) call and of a ConvertADCBufferToPressure(...)
+    // call (a whole buffer), since the last reset.
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t minBufferCycles;
+    uint32_t maxBufferCycles;
+} PressureStats;
+
+extern PressureStats pressureStats;
+void PressureStats_Reset(void);
+#endif
+
+// Table preparation (pressure_table_build.c). These are used at start-up for tables built in RAM, and
+// offline by the table generator for tables stored in Flash.
+void PressureFit_Init(PressureFit* pressureFitPtr, const PressureTableEntry* pressureTablePtr, int16_t tableSize);
+void PressureFitAccumulator_Init(PressureFitAccumulator* accumulatorPtr);
+void PressureFitAccumulator_Add(PressureFitAccumulator* accumulatorPtr, int32_t pressure, uint16_t adc);
+void PressureFitAccumulator_Remove(PressureFitAccumulator* accumulatorPtr, int32_t pressure, uint16_t adc);
+int16_t PressureFitAccumulator_GetFit(PressureFitAccumulator* accumulatorPtr, PressureFit* pressureFitPtr);
+int16_t PressureIndex_Init(PressureIndex* pressureIndexPtr, uint8_t* segments, const PressureTableEntry* entries, int16_t tableSize);
+int16_t PressureSlopes_Init(int32_t* slopes, const PressureTableEntry* entries, int16_t tableSize);
+int16_t PressureEytzinger_Init(PressureEytzinger* pressureEytzingerPtr, uint16_t* keys, uint16_t* ranks, const PressureTableEntry* entries, int16_t tableSize);
+int32_t PressureTable_UniformStep(const PressureTableEntry* entries, int16_t tableSize);
+void PressureTable_Init(PressureTable* tablePtr, const PressureTableEntry* entries, int16_t tableSize, const PressureIndex* pressureIndexPtr, const int32_t* segmentSlopesPtr);
+void PressureTable_InitLUT(PressureTable* tablePtr, int32_t* lut);
+int16_t PressureCompactTable_Init(PressureCompactTable* tablePtr, uint16_t* adc, int16_t* pressureResiduals, const PressureTableEntry* entries, int16_t tableSize, const PressureIndex* pressureIndexPtr, const int32_t* segmentSlopesPtr);
+
+// Hot-swappable calibration tables (pressure_table_slot.c).
+void PressureTableSlot_Init(PressureTableSlot* slotPtr, const PressureTable* tablePtr);
+const PressureTable* PressureTableSlot_Active(const PressureTableSlot* slotPtr);
+uint8_t PressureTableSlot_Generation(const PressureTableSlot* slotPtr);
+PressureTable* PressureTableSlot_Inactive(PressureTableSlot* slotPtr);
+void PressureTableSlot_Publish(PressureTableSlot* slotPtr);
+
+// Conversion in place of the DMA buffer (pressure_ring.c).
+void ConvertADCBufferToPressurePacked(const uint16_t* in, uint8_t* out, size_t n, const PressureTable* t, const PressurePackedFormat* formatPtr);
+int32_t PressurePacked_Get(const PressurePackedFormat* formatPtr, const uint8_t* packed, size_t i);
+int16_t PressureRing_Init(PressureRing* ringPtr, const PressureTable* tablePtr, uint16_t* adc, uint8_t* pressures, uint16_t halfLength, const PressurePackedFormat* formatPtr);
+void PressureRing_OnHalfComplete(PressureRing* ringPtr);
+void PressureRing_OnComplete(PressureRing* ringPtr);
+const uint8_t* PressureRing_Acquire(PressureRing* ringPtr);
+void PressureRing_Release(PressureRing* ringPtr);
+
+// Conversion with the descriptor and its tables in AVR program memory (pressure_avr.c).
+int32_t ConvertADCReadingToPressureAVR(uint16_t adcReading, const PressureTable* tablePtr);
+void ConvertADCBufferToPressureAVR(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t);
+
+// Conversion functions, to be run in the microcontroller environment.
+int ConvertADCReadingToPressure(int adcReading, const PressureTable* tablePtr);
+void ConvertADCBufferToPressure(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t);
+int32_t ConvertADCReadingToPressureQ(uint32_t adcReading, const PressureTable* tablePtr, const PressureQFormat* formatPtr);
+void ConvertADCBufferToPressureQ(const uint32_t* in, int32_t* out, size_t n, const PressureTable* t, const PressureQFormat* formatPtr);
+void PressureTracker_Init(PressureTracker* trackerPtr, const PressureTable* tablePtr);
+int32_t ConvertADCReadingToPressureTracked(uint16_t adcReading, PressureTracker* trackerPtr);
+int16_t PressureSurface_Init(PressureSurfaceState* statePtr, const PressureSurface* surfacePtr, int16_t temperature);
+void PressureSurface_SetTemperature(PressureSurfaceState* statePtr, int16_t temperature);
+int32_t ConvertADCReadingToPressureSurface(uint16_t adcReading, PressureSurfaceState* statePtr);
+void ConvertADCBufferToPressureSurface(const uint16_t* in, int32_t* out, size_t n, PressureSurfaceState* statePtr);
+void ConvertADCBufferToPressureDecimated(const uint16_t* in, int32_t* out, size_t outCount, uint8_t decimationShift, const PressureTable* t);
+int ConvertADCReadingToPressureCompact(int adcReading, const PressureCompactTable* tablePtr);
+void ConvertADCBufferToPressureCompact(const uint16_t* in, int32_t* out, size_t n, const PressureCompactTable* t);
+int ConvertADCReadingToPressurePoly(int adcReading, const PressurePolyTable* tablePtr);
+void ConvertADCBufferToPressurePoly(const uint16_t* in, int32_t* out, size_t n, const PressurePolyTable* t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PRESSURE_SENSOR_H
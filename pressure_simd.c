@@ -0,0 +1,167 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Vectorized Batch Conversion
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts buffers of ADC readings with the vector units of the desktop CPU, e.g. to
+*   reprocess archived captures, giving the same results as ConvertADCBufferToPressure(...). With AVX2,
+*   8 readings are converted per iteration:
+*     1. The readings are clamped to the table bounds, so that every lane can be looked up safely.
+*     2. The segment of every lane is gathered from the direct segment index, followed by the same
+*        couple of linear steps as the scalar lookup, done for all lanes at once until none is left.
+*     3. The entries and the Q16 slopes of the segments are gathered, and the interpolation is done
+*        with the same multiply, rounding and shift as the scalar kernel. With a uniform pressure step,
+*        P1 is computed from the segment instead of being gathered.
+*     4. The exact last entry and the extrapolation of the readings outside of the table bounds are
+*        blended in.
+*   With the dense table of the descriptor (see PressureTable_InitLUT(...)), the conversion is a single
+*   gather of the 8 readings instead.
+*   The vector kernel is selected at run-time, when the CPU supports AVX2 and when the table descriptor
+*   provides either the dense table or both the index and the slopes. Otherwise, and for the last few
+*   readings of the buffer, the scalar ConvertADCBufferToPressure(...) is used.
+*
+*   Only AVX2 is implemented. SSE4.1 and NEON have no gather, so their kernel would find the segment with
+*   a branchless compare-and-count of every reading against every inner ADC reading of the table (or with
+*   byte shuffles, for a table or index of at most 16 to 64 bytes). With the 90 segments of pressureTable,
+*   that costs about 8 ns per reading, slower than the scalar kernel on anything but noise.
+*
+***************************************************************************************************/
+
+#include "pressure_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PRESSURE_VECTOR_AVX2 1
+#endif
+
+// Number of readings converted per iteration of the vector kernel.
+#define VECTOR_LANES 8
+
+#if defined(PRESSURE_VECTOR_AVX2)
+/* Gathers the segments of the direct index for 8 buckets. There is no byte gather, so the aligned 32 bit
+*  word holding every byte is gathered instead and shifted down. An aligned word never crosses a page
+*  boundary, so the bytes read beyond either end of the index can never fault, and are discarded.
+*/
+__attribute__((target("avx2")))
+static __m256i GatherIndexSegments(const uint8_t* segments, __m256i buckets) {
+    const int* words = (const int*)((uintptr_t)segments & ~(uintptr_t)3);
+    __m256i offsets = _mm256_add_epi32(buckets, _mm256_set1_epi32((int)((uintptr_t)segments & 3)));
+    __m256i values = _mm256_i32gather_epi32(words, _mm256_srli_epi32(offsets, 2), 4);
+    __m256i shifts = _mm256_slli_epi32(_mm256_and_si256(offsets, _mm256_set1_epi32(3)), 3);
+
+    return _mm256_and_si256(_mm256_srlv_epi32(values, shifts), _mm256_set1_epi32(0xFF));
+}
+
+/* Gathers the ADC readings of the given entries. Every entry is 8 bytes long (see PressureVector_IsSupported(...)),
+*  and the padding following the 16 bit reading is masked out.
+*/
+__attribute__((target("avx2")))
+static __m256i GatherEntryADC(const PressureTableEntry* entries, __m256i segments) {
+    const int* adcBase = (const int*)((const char*)entries + offsetof(PressureTableEntry, adc));
+    return _mm256_and_si256(_mm256_i32gather_epi32(adcBase, segments, 8), _mm256_set1_epi32(0xFFFF));
+}
+
+/* With the dense table of the descriptor, the whole conversion is one gather of 8 readings. */
+__attribute__((target("avx2")))
+static size_t ConvertADCBufferToPressureLUTAVX2(const uint16_t* in, int32_t* out, size_t n, const int32_t* lut) {
+    size_t i;
+
+    for (i = 0; (i + VECTOR_LANES) <= n; i += VECTOR_LANES) {
+        __m256i adcReading = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&in[i]));
+        _mm256_storeu_si256((__m256i*)&out[i], _mm256_i32gather_epi32((const int*)lut, adcReading, 4));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t ConvertADCBufferToPressureAVX2(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    const PressureTableEntry* entries = t->entries;
+    const PressureIndex* pressureIndexPtr = t->index;
+    const int16_t tableSize = t->tableSize;
+    const __m256i minADC = _mm256_set1_epi32(entries[0].adc);
+    const __m256i maxADC = _mm256_set1_epi32(entries[tableSize].adc);
+    const __m256i lastSearchADC = _mm256_set1_epi32(entries[tableSize].adc - 1);
+    const __m256i lastPressure = _mm256_set1_epi32(entries[tableSize].pressure);
+    const __m256i firstBucket = _mm256_set1_epi32(pressureIndexPtr->firstBucket);
+    // The scalar kernel truncates the 64 bit extrapolation to 32 bits, which only depends on the low
+    // 32 bits of the fit.
+    const __m256i fitSlope = _mm256_set1_epi32((int32_t)(uint32_t)t->fit.slope);
+    const __m256i fitIntercept = _mm256_set1_epi32((int32_t)(uint32_t)t->fit.intercept);
+    const __m256i rounding = _mm256_set1_epi32(1 << (PRESSURE_SLOPE_SHIFT - 1));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i basePressure = _mm256_set1_epi32(entries[0].pressure);
+    const __m256i pressureStep = _mm256_set1_epi32(t->pressureStep);
+    size_t i;
+
+    for (i = 0; (i + VECTOR_LANES) <= n; i += VECTOR_LANES) {
+        __m256i adcReading = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&in[i]));
+        __m256i searchADC = _mm256_max_epi32(_mm256_min_epi32(adcReading, lastSearchADC), minADC);
+        __m256i buckets = _mm256_sub_epi32(_mm256_srli_epi32(searchADC, PRESSURE_INDEX_SHIFT), firstBucket);
+        __m256i segment = GatherIndexSegments(pressureIndexPtr->segments, buckets);
+        __m256i outOfRange = _mm256_or_si256(_mm256_cmpgt_epi32(minADC, adcReading), _mm256_cmpgt_epi32(adcReading, maxADC));
+        __m256i P1;
+        __m256i ADC1;
+        __m256i offset;
+        __m256i pressure;
+
+        for (;;) {
+            // Lanes still at or beyond the end of their segment move on to the next one.
+            __m256i ADC2 = GatherEntryADC(entries, _mm256_add_epi32(segment, one));
+            __m256i step = _mm256_cmpgt_epi32(searchADC, _mm256_sub_epi32(ADC2, one));
+            if (_mm256_testz_si256(step, step)) {
+                break;
+            }
+            segment = _mm256_sub_epi32(segment, step);
+        }
+
+        if (t->pressureStep != 0) {
+            P1 = _mm256_add_epi32(basePressure, _mm256_mullo_epi32(pressureStep, segment));
+        }
+        else {
+            P1 = _mm256_i32gather_epi32((const int*)&entries[0].pressure, segment, 8);
+        }
+        ADC1 = GatherEntryADC(entries, segment);
+        offset = _mm256_mullo_epi32(_mm256_i32gather_epi32((const int*)t->slopes, segment, 4), _mm256_sub_epi32(searchADC, ADC1));
+        pressure = _mm256_add_epi32(P1, _mm256_srai_epi32(_mm256_add_epi32(offset, rounding), PRESSURE_SLOPE_SHIFT));
+
+        pressure = _mm256_blendv_epi8(pressure, lastPressure, _mm256_cmpeq_epi32(adcReading, maxADC));
+        pressure = _mm256_blendv_epi8(pressure, _mm256_add_epi32(_mm256_mullo_epi32(fitSlope, adcReading), fitIntercept), outOfRange);
+        _mm256_storeu_si256((__m256i*)&out[i], pressure);
+    }
+    return i;
+}
+#endif
+
+/* Returns 1 if ConvertADCBufferToPressureVector(...) runs the vector kernel for the given table on
+*  this CPU, and 0 if it falls back to the scalar kernel.
+*/
+int PressureVector_IsSupported(const PressureTable* t) {
+#if defined(PRESSURE_VECTOR_AVX2)
+    // The gathers address the entries with a stride of 8 bytes, the pressure first.
+    if ((sizeof(PressureTableEntry) != 8) || (offsetof(PressureTableEntry, pressure) != 0)) {
+        return 0;
+    }
+    return ((t->lut != NULL) || ((t->index != NULL) && (t->slopes != NULL))) && __builtin_cpu_supports("avx2");
+#else
+    (void)t;
+    return 0;
+#endif
+}
+
+/* This function converts a buffer of ADC readings to pressure readings, giving the same results as
+*  ConvertADCBufferToPressure(...), with the vector units when supported (see PressureVector_IsSupported(...)).
+*  Unlike the scalar kernel, it does not rely on consecutive readings falling in the same segment, so its
+*  throughput does not depend on the signal.
+*/
+void ConvertADCBufferToPressureVector(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t) {
+    size_t converted = 0;
+
+#if defined(PRESSURE_VECTOR_AVX2)
+    if (PressureVector_IsSupported(t)) {
+        converted = (t->lut != NULL) ? ConvertADCBufferToPressureLUTAVX2(in, out, n, t->lut) : ConvertADCBufferToPressureAVX2(in, out, n, t);
+    }
+#endif
+    ConvertADCBufferToPressure(&in[converted], &out[converted], n - converted, t);
+}
@@ -0,0 +1,20 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Vectorized Batch Conversion
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Vectorized batch conversion of ADC readings in a desktop environment (see pressure_simd.c).
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_SIMD_H
+#define PRESSURE_SIMD_H
+
+#include "pressure_sensor.h"
+
+int PressureVector_IsSupported(const PressureTable* t);
+void ConvertADCBufferToPressureVector(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t);
+
+#endif // PRESSURE_SIMD_H
@@ -0,0 +1,374 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Stream Conversion
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module converts whole ADC logs in a desktop environment, e.g. to reprocess raw field logs
+*   offline. The input is read in large blocks, converted with the vectorized batch conversion function and
+*   written back in large blocks, so that there is no per-sample stdio call. Only the converted
+*   values are written, one per line for the text output.
+*
+*   For binary capture files, PressureStream_ConvertMappedFile(...) avoids stdio altogether: both the
+*   input and the output files are memory-mapped, and the batch conversion function runs directly over
+*   the mapped pages, without any intermediate copy or per-sample system call.
+*
+***************************************************************************************************/
+
+#include "pressure_simd.h"
+#include "pressure_stream.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PRESSURE_STREAM_HAS_MMAP 1
+#endif
+
+// Number of samples converted per call to ConvertADCBufferToPressureVector(...).
+#define STREAM_BLOCK_SAMPLES 16384
+#define STREAM_BLOCK_BYTES (STREAM_BLOCK_SAMPLES * sizeof(uint16_t))
+// Longest text pressure reading: a sign, 10 digits and a newline.
+#define MAX_TEXT_PRESSURE_LENGTH 12
+// Number of samples converted per call to ConvertADCBufferToPressureVector(...) over memory-mapped files. A
+// chunk (64 KiB of samples and 128 KiB of pressures) fits in the L2 cache of the worker converting it.
+#define MAPPED_CHUNK_SAMPLES 32768
+
+typedef struct {
+    FILE* out;
+    PressureStreamFormat format;
+    const PressureTable* table;
+    uint16_t samples[STREAM_BLOCK_SAMPLES];
+    int32_t pressures[STREAM_BLOCK_SAMPLES];
+    char text[STREAM_BLOCK_SAMPLES * MAX_TEXT_PRESSURE_LENGTH];
+} StreamState;
+
+// A single stream is converted at a time, and the buffers are too large for the stack.
+static StreamState stream;
+
+/* Formats the pressure reading as a decimal line, and returns the number of characters written. */
+static size_t FormatPressure(int32_t pressure, char* text) {
+    char digits[10];
+    size_t digitCount = 0;
+    size_t length = 0;
+    uint32_t value = (pressure < 0) ? (0u - (uint32_t)pressure) : (uint32_t)pressure;
+
+    if (pressure < 0) {
+        text[length++] = '-';
+    }
+    do {
+        digits[digitCount++] = (char)('0' + value % 10);
+        value = value / 10;
+    } while (value != 0);
+    while (digitCount > 0) {
+        text[length++] = digits[--digitCount];
+    }
+    text[length++] = '\n';
+    return length;
+}
+
+/* Converts the first n buffered samples and writes the results. Returns 0 on success and -1 on error. */
+static int ConvertBlock(StreamState* s, size_t n) {
+    size_t length = 0;
+
+    ConvertADCBufferToPressureVector(s->samples, s->pressures, n, s->table);
+    if (s->format == PRESSURE_STREAM_BINARY) {
+        // Serialized byte by byte so that the output is little-endian on any host. The result is
+        // written over the text buffer, which is large enough for it.
+        unsigned char* bytes = (unsigned char*)s->text;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t value = (uint32_t)s->pressures[i];
+            bytes[length++] = (unsigned char)value;
+            bytes[length++] = (unsigned char)(value >> 8);
+            bytes[length++] = (unsigned char)(value >> 16);
+            bytes[length++] = (unsigned char)(value >> 24);
+        }
+    }
+    else {
+        for (size_t i = 0; i < n; i++) {
+            length += FormatPressure(s->pressures[i], &s->text[length]);
+        }
+    }
+    if (fwrite(s->text, 1, length, s->out) != length) {
+        fprintf(stderr, "Error occured while writing the pressure readings.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Reads raw little-endian uint16_t samples. A trailing odd byte is reported as an error. */
+static int ConvertBinaryStream(StreamState* s, FILE* in) {
+    unsigned char bytes[STREAM_BLOCK_BYTES];
+    size_t pending = 0;
+    size_t count;
+
+    while ((count = fread(&bytes[pending], 1, sizeof(bytes) - pending, in)) > 0) {
+        size_t available = pending + count;
+        size_t n = available / 2;
+
+        for (size_t i = 0; i < n; i++) {
+            s->samples[i] = (uint16_t)(bytes[2 * i] | (bytes[2 * i + 1] << 8));
+        }
+        if ((n > 0) && (ConvertBlock(s, n) != 0)) {
+            return -1;
+        }
+        // An odd byte is kept for the next block, since reads are not required to return whole samples.
+        pending = available - 2 * n;
+        if (pending != 0) {
+            bytes[0] = bytes[available - 1];
+        }
+    }
+    if (ferror(in)) {
+        fprintf(stderr, "Error occured while reading the ADC samples.\n");
+        return -1;
+    }
+    if (pending != 0) {
+        fprintf(stderr, "The input ends with an incomplete ADC sample.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Reads whitespace separated decimal ADC readings. A reading may span two blocks of the input. */
+static int ConvertTextStream(StreamState* s, FILE* in) {
+    char text[STREAM_BLOCK_BYTES];
+    uint32_t value = 0;
+    int inReading = 0;
+    size_t n = 0;
+    unsigned long lineNumber = 1;
+    size_t count;
+
+    while ((count = fread(text, 1, sizeof(text), in)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            char c = text[i];
+
+            if ((c >= '0') && (c <= '9')) {
+                value = value * 10 + (uint32_t)(c - '0');
+                inReading = 1;
+                if (value > UINT16_MAX) {
+                    fprintf(stderr, "Line %lu: the ADC reading exceeds %u.\n", lineNumber, UINT16_MAX);
+                    return -1;
+                }
+            }
+            else if ((c == '\n') || (c == ' ') || (c == '\t') || (c == '\r') || (c == ',')) {
+                if (inReading) {
+                    s->samples[n++] = (uint16_t)value;
+                    value = 0;
+                    inReading = 0;
+                    if (n == STREAM_BLOCK_SAMPLES) {
+                        if (ConvertBlock(s, n) != 0) {
+                            return -1;
+                        }
+                        n = 0;
+                    }
+                }
+                lineNumber += (c == '\n');
+            }
+            else {
+                fprintf(stderr, "Line %lu: invalid character in ADC reading.\n", lineNumber);
+                return -1;
+            }
+        }
+    }
+    if (ferror(in)) {
+        fprintf(stderr, "Error occured while reading the ADC readings.\n");
+        return -1;
+    }
+    if (inReading) {
+        s->samples[n++] = (uint16_t)value;
+    }
+    if ((n > 0) && (ConvertBlock(s, n) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* This function converts every ADC reading of the input stream to a pressure reading with the given
+*  table, until the end of the input. The output only holds the converted values, in the same order.
+*  Returns 0 on success and -1 on error, after reporting it on stderr.
+*/
+int PressureStream_Convert(FILE* in, FILE* out, PressureStreamFormat inputFormat, PressureStreamFormat outputFormat, const PressureTable* t) {
+    int result;
+
+    stream.out = out;
+    stream.format = outputFormat;
+    stream.table = t;
+    if (inputFormat == PRESSURE_STREAM_BINARY) {
+        result = ConvertBinaryStream(&stream, in);
+    }
+    else {
+        result = ConvertTextStream(&stream, in);
+    }
+    if ((result == 0) && (fflush(out) != 0)) {
+        fprintf(stderr, "Error occured while writing the pressure readings.\n");
+        result = -1;
+    }
+    return result;
+}
+
+#if defined(PRESSURE_STREAM_HAS_MMAP)
+typedef struct {
+    const uint16_t* in;
+    int32_t* out;
+    size_t n;
+    const PressureTable* table;
+    // Index of the next chunk to be converted, claimed atomically by the workers.
+    size_t nextChunk;
+} MappedConversion;
+
+/* Worker of the mapped conversion. Every chunk is converted in place in the output mapping, so the
+*  output order does not depend on which worker converted which chunk.
+*/
+static void* ConvertMappedChunks(void* arg) {
+    MappedConversion* c = (MappedConversion*)arg;
+    size_t chunkCount = (c->n + MAPPED_CHUNK_SAMPLES - 1) / MAPPED_CHUNK_SAMPLES;
+    size_t chunk;
+
+    while ((chunk = __atomic_fetch_add(&c->nextChunk, 1, __ATOMIC_RELAXED)) < chunkCount) {
+        size_t offset = chunk * MAPPED_CHUNK_SAMPLES;
+        size_t length = ((c->n - offset) < MAPPED_CHUNK_SAMPLES) ? (c->n - offset) : MAPPED_CHUNK_SAMPLES;
+        ConvertADCBufferToPressureVector(&c->in[offset], &c->out[offset], length, c->table);
+    }
+    return NULL;
+}
+
+/* Runs the conversion directly from the mapped input pages into the mapped output pages, with the
+*  calling thread and threadCount - 1 additional workers.
+*/
+static void ConvertMappedSamples(const uint16_t* in, int32_t* out, size_t n, const PressureTable* t, unsigned threadCount) {
+    MappedConversion c = { in, out, n, t, 0 };
+    pthread_t workers[PRESSURE_STREAM_MAX_THREADS];
+    unsigned started = 0;
+
+    if (threadCount > PRESSURE_STREAM_MAX_THREADS) {
+        threadCount = PRESSURE_STREAM_MAX_THREADS;
+    }
+    // A worker that cannot be started is not an error, its chunks are taken by the others.
+    while ((started + 1 < threadCount) && (pthread_create(&workers[started], NULL, ConvertMappedChunks, &c) == 0)) {
+        started++;
+    }
+    ConvertMappedChunks(&c);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+/* Allocates the blocks of the whole output file, so that a full disk is reported here rather than as a
+*  SIGBUS on the first store into a page that cannot be backed. Returns 0 on success and the error number
+*  otherwise. Without posix_fallocate(...), the file is only extended.
+*/
+static int PreallocateOutput(int outputFile, off_t size) {
+#if defined(__APPLE__)
+    return (ftruncate(outputFile, size) == 0) ? 0 : errno;
+#else
+    return posix_fallocate(outputFile, 0, size);
+#endif
+}
+#endif
+
+/* This function converts a raw capture file of little-endian uint16_t ADC samples into a file of
+*  little-endian int32_t pressure readings, e.g. for multi-GB field captures. The output file, which must
+*  not be the input file, is created (or truncated) and its blocks are allocated to its final size, then
+*  both files are memory-mapped and converted in chunks directly over the mapped pages, which are synced
+*  to the file before returning. The chunks are shared by threadCount worker threads (0 for one
+*  per online CPU), since every sample is converted independently of the others. This requires a
+*  little-endian host with POSIX mmap and threads.
+*  Returns 0 on success and -1 on error, after reporting it on stderr.
+*/
+int PressureStream_ConvertMappedFile(const char* inputPath, const char* outputPath, const PressureTable* t, unsigned threadCount) {
+#if defined(PRESSURE_STREAM_HAS_MMAP) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    const uint16_t* in = NULL;
+    int32_t* out = NULL;
+    int inputFile;
+    int outputFile;
+    struct stat inputStat;
+    struct stat outputStat;
+    size_t n;
+    int error;
+    int result = -1;
+
+    inputFile = open(inputPath, O_RDONLY);
+    if (inputFile < 0) {
+        fprintf(stderr, "%s: cannot open the ADC capture.\n", inputPath);
+        return -1;
+    }
+    if ((fstat(inputFile, &inputStat) != 0) || ((inputStat.st_size % sizeof(uint16_t)) != 0)) {
+        fprintf(stderr, "%s: the ADC capture does not hold whole uint16 samples.\n", inputPath);
+        close(inputFile);
+        return -1;
+    }
+    n = (size_t)inputStat.st_size / sizeof(uint16_t);
+    if (n > SIZE_MAX / sizeof(int32_t)) {
+        fprintf(stderr, "%s: the ADC capture is too large to be mapped.\n", inputPath);
+        close(inputFile);
+        return -1;
+    }
+    // Truncating the capture itself (e.g. through a link) would destroy it before it is converted.
+    if ((stat(outputPath, &outputStat) == 0) && (outputStat.st_dev == inputStat.st_dev) && (outputStat.st_ino == inputStat.st_ino)) {
+        fprintf(stderr, "%s: the output file is the ADC capture itself.\n", outputPath);
+        close(inputFile);
+        return -1;
+    }
+    outputFile = open(outputPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (outputFile < 0) {
+        fprintf(stderr, "%s: cannot create the output file.\n", outputPath);
+        close(inputFile);
+        return -1;
+    }
+    if (n == 0) {
+        result = 0;
+    }
+    else if ((error = PreallocateOutput(outputFile, (off_t)(n * sizeof(int32_t)))) != 0) {
+        fprintf(stderr, "%s: cannot preallocate the output file (%s).\n", outputPath, strerror(error));
+    }
+    else {
+        in = mmap(NULL, n * sizeof(uint16_t), PROT_READ, MAP_PRIVATE, inputFile, 0);
+        out = mmap(NULL, n * sizeof(int32_t), PROT_READ | PROT_WRITE, MAP_SHARED, outputFile, 0);
+        if ((in == MAP_FAILED) || (out == MAP_FAILED)) {
+            fprintf(stderr, "Cannot memory-map the ADC capture or the output file.\n");
+        }
+        else {
+            // Both files are only accessed once, in order, so let the kernel read ahead aggressively.
+            madvise((void*)in, n * sizeof(uint16_t), MADV_SEQUENTIAL);
+            madvise(out, n * sizeof(int32_t), MADV_SEQUENTIAL);
+            if (threadCount == 0) {
+                long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+                threadCount = (cpuCount > 0) ? (unsigned)cpuCount : 1;
+            }
+            ConvertMappedSamples(in, out, n, t, threadCount);
+            // The pages are written back before returning, so that a write error is reported here.
+            if (msync(out, n * sizeof(int32_t), MS_SYNC) != 0) {
+                fprintf(stderr, "%s: error occured while writing the output file.\n", outputPath);
+            }
+            else {
+                result = 0;
+            }
+        }
+        if (in != MAP_FAILED) {
+            munmap((void*)in, n * sizeof(uint16_t));
+        }
+        if ((out != MAP_FAILED) && (munmap(out, n * sizeof(int32_t)) != 0)) {
+            fprintf(stderr, "%s: cannot unmap the output file.\n", outputPath);
+            result = -1;
+        }
+    }
+    close(inputFile);
+    if (close(outputFile) != 0) {
+        fprintf(stderr, "%s: error occured while writing the output file.\n", outputPath);
+        result = -1;
+    }
+    return result;
+#else
+    (void)inputPath;
+    (void)outputPath;
+    (void)t;
+    (void)threadCount;
+    fprintf(stderr, "Memory-mapped conversion requires a little-endian host with POSIX mmap.\n");
+    return -1;
+#endif
+}
@@ -0,0 +1,32 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Stream Conversion
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Bulk conversion of ADC logs in a desktop environment (see pressure_stream.c).
+*
+***************************************************************************************************/
+
+#ifndef PRESSURE_STREAM_H
+#define PRESSURE_STREAM_H
+
+#include <stdio.h>
+
+#include "pressure_sensor.h"
+
+// Largest number of worker threads of PressureStream_ConvertMappedFile(...).
+#define PRESSURE_STREAM_MAX_THREADS 256
+
+typedef enum {
+    // Newline (or any whitespace) separated decimal integers.
+    PRESSURE_STREAM_TEXT,
+    // Raw little-endian uint16_t ADC samples for the input, little-endian int32_t pressures for the output.
+    PRESSURE_STREAM_BINARY
+} PressureStreamFormat;
+
+int PressureStream_Convert(FILE* in, FILE* out, PressureStreamFormat inputFormat, PressureStreamFormat outputFormat, const PressureTable* t);
+int PressureStream_ConvertMappedFile(const char* inputPath, const char* outputPath, const PressureTable* t, unsigned threadCount);
+
+#endif // PRESSURE_STREAM_H
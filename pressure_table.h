@@ -0,0 +1,198 @@
+/* Generated by tools/gen_pressure_table from calibration/pressure_table.csv. Do not edit, regenerate with "make table". */
+
+#ifndef PRESSURE_TABLE_H
+#define PRESSURE_TABLE_H
+
+#include "pressure_sensor.h"
+
+#if (PRESSURE_INDEX_SHIFT != 6) || (PRESSURE_SLOPE_SHIFT != 16)
+#error "pressureTable was generated with a different fixed-point format, regenerate it with \"make table\""
+#endif
+
+// Index of the last entry in pressureTable.
+#define PRESSURE_TABLE_SIZE 90
+
+// Entries of pressureTable as an X-macro list of (pressure, adc), which also makes them available to
+// compile-time code (e.g. pressure_converter.hpp).
+#define PRESSURE_TABLE_ENTRIES(ENTRY) \
+    ENTRY( 10000,   1696) \
+    ENTRY( 11000,   1909) \
+    ENTRY( 12000,   2118) \
+    ENTRY( 13000,   2272) \
+    ENTRY( 14000,   2366) \
+    ENTRY( 15000,   2448) \
+    ENTRY( 16000,   2570) \
+    ENTRY( 17000,   2745) \
+    ENTRY( 18000,   2931) \
+    ENTRY( 19000,   3073) \
+    ENTRY( 20000,   3151) \
+    ENTRY( 21000,   3200) \
+    ENTRY( 22000,   3278) \
+    ENTRY( 23000,   3411) \
+    ENTRY( 24000,   3573) \
+    ENTRY( 25000,   3706) \
+    ENTRY( 26000,   3777) \
+    ENTRY( 27000,   3808) \
+    ENTRY( 28000,   3853) \
+    ENTRY( 29000,   3955) \
+    ENTRY( 30000,   4100) \
+    ENTRY( 31000,   4236) \
+    ENTRY( 32000,   4316) \
+    ENTRY( 33000,   4348) \
+    ENTRY( 34000,   4382) \
+    ENTRY( 35000,   4468) \
+    ENTRY( 36000,   4610) \
+    ENTRY( 37000,   4762) \
+    ENTRY( 38000,   4871) \
+    ENTRY( 39000,   4927) \
+    ENTRY( 40000,   4971) \
+    ENTRY( 41000,   5058) \
+    ENTRY( 42000,   5210) \
+    ENTRY( 43000,   5390) \
+    ENTRY( 44000,   5541) \
+    ENTRY( 45000,   5639) \
+    ENTRY( 46000,   5710) \
+    ENTRY( 47000,   5812) \
+    ENTRY( 48000,   5979) \
+    ENTRY( 49000,   6190) \
+    ENTRY( 50000,   6389) \
+    ENTRY( 51000,   6534) \
+    ENTRY( 52000,   6641) \
+    ENTRY( 53000,   6762) \
+    ENTRY( 54000,   6943) \
+    ENTRY( 55000,   7177) \
+    ENTRY( 56000,   7414) \
+    ENTRY( 57000,   7604) \
+    ENTRY( 58000,   7743) \
+    ENTRY( 59000,   7877) \
+    ENTRY( 60000,   8060) \
+    ENTRY( 61000,   8302) \
+    ENTRY( 62000,   8560) \
+    ENTRY( 63000,   8778) \
+    ENTRY( 64000,   8938) \
+    ENTRY( 65000,   9074) \
+    ENTRY( 66000,   9243) \
+    ENTRY( 67000,   9470) \
+    ENTRY( 68000,   9726) \
+    ENTRY( 69000,   9954) \
+    ENTRY( 70000,  10119) \
+    ENTRY( 71000,  10244) \
+    ENTRY( 72000,  10383) \
+    ENTRY( 73000,  10577) \
+    ENTRY( 74000,  10810) \
+    ENTRY( 75000,  11028) \
+    ENTRY( 76000,  11187) \
+    ENTRY( 77000,  11292) \
+    ENTRY( 78000,  11394) \
+    ENTRY( 79000,  11542) \
+    ENTRY( 80000,  11739) \
+    ENTRY( 81000,  11937) \
+    ENTRY( 82000,  12085) \
+    ENTRY( 83000,  12170) \
+    ENTRY( 84000,  12237) \
+    ENTRY( 85000,  12340) \
+    ENTRY( 86000,  12498) \
+    ENTRY( 87000,  12675) \
+    ENTRY( 88000,  12815) \
+    ENTRY( 89000,  12893) \
+    ENTRY( 90000,  12938) \
+    ENTRY( 91000,  13007) \
+    ENTRY( 92000,  13135) \
+    ENTRY( 93000,  13299) \
+    ENTRY( 94000,  13444) \
+    ENTRY( 95000,  13531) \
+    ENTRY( 96000,  13575) \
+    ENTRY( 97000,  13631) \
+    ENTRY( 98000,  13744) \
+    ENTRY( 99000,  13908) \
+    ENTRY(100000,  14073)
+
+static const PressureTableEntry pressureTable[] PRESSURE_FLASH_DATA = {
+    PRESSURE_TABLE_ENTRIES(PRESSURE_TABLE_ENTRY)
+};
+
+// Least-squares fit of pressureTable, used for extrapolation.
+static const PressureFit pressureTableFit PRESSURE_FLASH_DATA = { INT64_C(6), INT64_C(1580) };
+
+// Fixed-point slope of every pressureTable segment, with PRESSURE_SLOPE_SHIFT fractional bits.
+static const int32_t pressureTableSlopes[] PRESSURE_FLASH_DATA = {
+     307681,  313569,  425558,  697191,  799220,  537180,  374491,  352344,
+     461521,  840205, 1337469,  840205,  492752,  404543,  492752,  923042,
+    2114065, 1456356,  642510,  451972,  481882,  819200, 2048000, 1927529,
+     762047,  461521,  431158,  601248, 1170286, 1489455,  753287,  431158,
+     364089,  434013,  668735,  923042,  642510,  392431,  310597,  329327,
+     451972,  612486,  541620,  362077,  280068,  276523,  344926,  471482,
+     489075,  358120,  270810,  254016,  300624,  409600,  481882,  387787,
+     288705,  256000,  287439,  397188,  524288,  471482,  337814,  281270,
+     300624,  412176,  624152,  642510,  442811,  332670,  330990,  442811,
+     771012,  978149,  636272,  414785,  370260,  468114,  840205, 1456356,
+     949797,  512000,  399610,  451972,  753287, 1489455, 1170286,  579965,
+     399610,  397188,
+};
+
+// Direct segment index of pressureTable, keyed on adcReading >> PRESSURE_INDEX_SHIFT (6).
+static const uint8_t pressureTableIndexSegments[] PRESSURE_FLASH_DATA = {
+      0,   0,   0,   0,   1,   1,   1,   1,   2,   2,   3,   4,   4,   5,   5,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,  11,  11,  12,  12,  13,  13,  14,  14,
+     15,  15,  17,  18,  19,  19,  19,  20,  20,  21,  23,  24,  25,  25,  25,  26,
+     26,  27,  27,  29,  30,  30,  31,  31,  32,  32,  32,  33,  33,  34,  34,  35,
+     36,  37,  37,  37,  38,  38,  38,  39,  39,  39,  40,  40,  40,  41,  42,  42,
+     43,  43,  43,  44,  44,  44,  44,  45,  45,  45,  46,  46,  46,  47,  47,  48,
+     48,  48,  49,  49,  50,  50,  50,  50,  51,  51,  51,  51,  52,  52,  52,  52,
+     53,  53,  54,  54,  55,  55,  55,  56,  56,  56,  57,  57,  57,  57,  58,  58,
+     58,  58,  59,  59,  59,  60,  60,  61,  61,  62,  62,  62,  63,  63,  63,  64,
+     64,  64,  64,  65,  65,  66,  66,  67,  67,  68,  68,  69,  69,  69,  70,  70,
+     70,  71,  71,  72,  72,  73,  74,  75,  75,  75,  76,  76,  76,  77,  77,  78,
+     79,  80,  81,  81,  82,  82,  83,  83,  83,  84,  85,  87,  87,  88,  88,  88,
+     89,  89,
+};
+
+static const PressureIndex pressureTableIndex PRESSURE_FLASH_DATA = { pressureTableIndexSegments, 26, 194 };
+
+// Descriptor of pressureTable for the conversion functions.
+static const PressureTable pressureTableDescriptor PRESSURE_FLASH_DATA = {
+    pressureTable,
+    PRESSURE_TABLE_SIZE,
+    { INT64_C(6), INT64_C(1580) },
+    &pressureTableIndex,
+    pressureTableSlopes,
+    NULL,
+    1000,
+    NULL
+};
+
+// Compact form of pressureTable: pressure i is 10000 + 1000 * i.
+static const uint16_t pressureTableCompactADC[] PRESSURE_FLASH_DATA = {
+     1696,  1909,  2118,  2272,  2366,  2448,  2570,  2745,  2931,  3073,  3151,  3200,
+     3278,  3411,  3573,  3706,  3777,  3808,  3853,  3955,  4100,  4236,  4316,  4348,
+     4382,  4468,  4610,  4762,  4871,  4927,  4971,  5058,  5210,  5390,  5541,  5639,
+     5710,  5812,  5979,  6190,  6389,  6534,  6641,  6762,  6943,  7177,  7414,  7604,
+     7743,  7877,  8060,  8302,  8560,  8778,  8938,  9074,  9243,  9470,  9726,  9954,
+    10119, 10244, 10383, 10577, 10810, 11028, 11187, 11292, 11394, 11542, 11739, 11937,
+    12085, 12170, 12237, 12340, 12498, 12675, 12815, 12893, 12938, 13007, 13135, 13299,
+    13444, 13531, 13575, 13631, 13744, 13908, 14073,
+};
+
+static const PressureCompactTable pressureTableCompact PRESSURE_FLASH_DATA = {
+    pressureTableCompactADC,
+    NULL,
+    10000,
+    1000,
+    PRESSURE_TABLE_SIZE,
+    { INT64_C(6), INT64_C(1580) },
+    &pressureTableIndex,
+    pressureTableSlopes
+};
+
+#if defined(PRESSURE_FLASH_IN_PROGRAM_MEMORY) && !defined(PRESSURE_ALLOW_RAM_CONVERSIONS)
+// The descriptors above are in program memory, which the functions below would read as RAM. Convert
+// with ConvertADCReadingToPressureAVR(...) and ConvertADCBufferToPressureAVR(...) instead, or define
+// PRESSURE_ALLOW_RAM_CONVERSIONS to convert with tables built in RAM in this translation unit.
+#pragma GCC poison ConvertADCReadingToPressure ConvertADCBufferToPressure
+#pragma GCC poison ConvertADCReadingToPressureQ ConvertADCBufferToPressureQ ConvertADCBufferToPressureDecimated
+#pragma GCC poison PressureTracker_Init PressureTableSlot_Init PressureRing_Init ConvertADCBufferToPressurePacked
+#pragma GCC poison ConvertADCReadingToPressureCompact ConvertADCBufferToPressureCompact
+#pragma GCC poison ConvertADCReadingToPressurePoly ConvertADCBufferToPressurePoly
+#endif
+
+#endif // PRESSURE_TABLE_H
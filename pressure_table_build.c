@@ -0,0 +1,331 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Table Preparation
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module provides the functions that precompute the data used by the conversion functions from
+*   a Pressure-ADC table: the extrapolation fit, the direct segment index, the segment slopes, the
+*   Eytzinger layout of the ADC readings and the compact form of the table. They
+*   are run once per table, either at start-up for a table built in RAM, or offline by the table 
+*   generator (tools/gen_pressure_table.c) for a table stored in Flash.
+*
+***************************************************************************************************/
+
+#include "pressure_sensor.h"
+
+/* This function computes the least-squares linear fit of the Pressure-ADC table, which is used by
+*  ConvertADCReadingToPressure(...) to extrapolate readings outside of the table bounds.
+*      Least Squares minimization to arrive at equations for the slope (m) and y-intercept (b),
+*      result in the following formulae:
+*          m = (N * sum(ADC_i * P_i) - sum(ADC_i) * sum(P_i)) / N * sum(ADC_i^2) - (sum(ADC_i))^2
+*          b = (sum(ADC_i^2) * sum(P_i) - sum(ADC_i) * sum(ADC_i * P_i)) / N * sum(ADC_i^2) - (sum(ADC_i))^2
+*      Where N is the total number of data points in the available data set, ADC_i is ADC reading
+*      element i in the data set, P_i is Pressure reading i in the data set, and sum(x) denotes 
+*      the summation of expression x across all values of ADC_i and/or P_i for i = 0, ..., N.
+*
+*  The fit only depends on the table, so it should be computed once (e.g. at start-up, or offline by the
+*  table generator for a table stored in Flash) and kept in the table descriptor. tableSize is the index
+*  of the last entry in the table, as for all of the table preparation functions. The sums are those of
+*  a PressureFitAccumulator, so a fit computed incrementally for the same points is identical.
+*
+*  IMPORTANT: This function requires 64-bit integers. If this variable type does not exist in the 
+*             microcontroller environment, then the fit must be computed offline.
+*/
+void PressureFit_Init(PressureFit* pressureFitPtr, const PressureTableEntry* pressureTablePtr, int16_t tableSize) {
+    PressureFitAccumulator accumulator;
+
+    PressureFitAccumulator_Init(&accumulator);
+    for (int16_t i = 0; i <= tableSize; i++) {
+        PressureFitAccumulator_Add(&accumulator, pressureTablePtr[i].pressure, pressureTablePtr[i].adc);
+    }
+    if (PressureFitAccumulator_GetFit(&accumulator, pressureFitPtr) != 0) {
+        // A table whose entries do not define a fit extrapolates to 0.
+        pressureFitPtr->slope = 0;
+        pressureFitPtr->intercept = 0;
+    }
+}
+
+/* This function starts an incremental least-squares fit without any point. Points (e.g. reference gauge
+*  pressures and the matching ADC readings of a calibration session) are then added and removed in
+*  O(1) each, and the fit is only recomputed from the running sums when it is requested.
+*/
+void PressureFitAccumulator_Init(PressureFitAccumulator* accumulatorPtr) {
+    accumulatorPtr->sumOfADC_iTimesP_i = 0;
+    accumulatorPtr->sumOfADC_i = 0;
+    accumulatorPtr->sumOfP_i = 0;
+    accumulatorPtr->sumOfADC_iSquared = 0;
+    accumulatorPtr->pointCount = 0;
+    accumulatorPtr->fitIsValid = 0;
+}
+
+/* Adds a point to the fit. The pressure is scaled by FIXED_POINT_ARITH, as in the table. */
+void PressureFitAccumulator_Add(PressureFitAccumulator* accumulatorPtr, int32_t pressure, uint16_t adc) {
+    // NOTE: To prevent bit overflow with the provided data set, either 64-bit integer types are needed 
+    //       for Fixed-Point arithmetic operations or SW/HW level floating point support is needed for 
+    //       the 32-bit float data type. 
+    accumulatorPtr->sumOfADC_iTimesP_i = accumulatorPtr->sumOfADC_iTimesP_i + (int64_t)adc * (pressure / FIXED_POINT_ARITH);
+    accumulatorPtr->sumOfADC_i = accumulatorPtr->sumOfADC_i + adc;
+    accumulatorPtr->sumOfP_i = accumulatorPtr->sumOfP_i + pressure / FIXED_POINT_ARITH;
+    accumulatorPtr->sumOfADC_iSquared = accumulatorPtr->sumOfADC_iSquared + (int64_t)adc * adc;
+    accumulatorPtr->pointCount++;
+    accumulatorPtr->fitIsValid = 0;
+}
+
+/* Removes a point previously added to the fit (e.g. a reference point found to be wrong). The sums are
+*  exact integers, so removing a point gives the same fit as never having added it.
+*/
+void PressureFitAccumulator_Remove(PressureFitAccumulator* accumulatorPtr, int32_t pressure, uint16_t adc) {
+    accumulatorPtr->sumOfADC_iTimesP_i = accumulatorPtr->sumOfADC_iTimesP_i - (int64_t)adc * (pressure / FIXED_POINT_ARITH);
+    accumulatorPtr->sumOfADC_i = accumulatorPtr->sumOfADC_i - adc;
+    accumulatorPtr->sumOfP_i = accumulatorPtr->sumOfP_i - pressure / FIXED_POINT_ARITH;
+    accumulatorPtr->sumOfADC_iSquared = accumulatorPtr->sumOfADC_iSquared - (int64_t)adc * adc;
+    accumulatorPtr->pointCount--;
+    accumulatorPtr->fitIsValid = 0;
+}
+
+/* This function returns the least-squares fit of the points added so far in pressureFitPtr, e.g. to be
+*  copied into the fit of a table descriptor in RAM. The fit is only recomputed from the running sums
+*  (with the formulae of PressureFit_Init(...)) if a point was added or removed since the last call.
+*  Returns 0 on success, or -1 (leaving pressureFitPtr unchanged) if the points do not define a fit,
+*  i.e. fewer than 2 points or all of them at the same ADC reading.
+*/
+int16_t PressureFitAccumulator_GetFit(PressureFitAccumulator* accumulatorPtr, PressureFit* pressureFitPtr) {
+    if (!accumulatorPtr->fitIsValid) {
+        // NOTE: The averages keep the "sum / N - 1" form that the TABLE_SIZE macro expansion has always
+        //       produced here, so that the extrapolated pressure readings are unchanged by the caching.
+        int64_t count = accumulatorPtr->pointCount;
+        int64_t sumOfADC_iTimesP_i;
+        int64_t sumOfADC_i;
+        int64_t sumOfP_i;
+        int64_t sumOfADC_iSquared;
+        int64_t denominator;
+
+        if (count < 2) {
+            return -1;
+        }
+        // The points are all at the same ADC reading exactly when the exact variance of the raw sums,
+        // sumOfADC_iSquared / count - mean^2, is 0. The biased averages below never give a zero
+        // denominator for such points, so the check is done first. It only uses the integer mean, which
+        // cannot overflow where the sums themselves do not.
+        if (((accumulatorPtr->sumOfADC_i % count) == 0)
+            && (accumulatorPtr->sumOfADC_iSquared == (accumulatorPtr->sumOfADC_i / count) * accumulatorPtr->sumOfADC_i)) {
+            return -1;
+        }
+        sumOfADC_iTimesP_i = accumulatorPtr->sumOfADC_iTimesP_i / count - 1;
+        sumOfADC_i = accumulatorPtr->sumOfADC_i / count - 1;
+        sumOfP_i = accumulatorPtr->sumOfP_i / count - 1;
+        sumOfADC_iSquared = accumulatorPtr->sumOfADC_iSquared / count - 1;
+        denominator = sumOfADC_iSquared - sumOfADC_i * sumOfADC_i;
+        if (denominator == 0) {
+            return -1;
+        }
+        accumulatorPtr->fit.slope = (sumOfADC_iTimesP_i - sumOfADC_i * sumOfP_i) * FIXED_POINT_ARITH / denominator;
+        accumulatorPtr->fit.intercept = (sumOfADC_iSquared * sumOfP_i - sumOfADC_i * sumOfADC_iTimesP_i) * FIXED_POINT_ARITH / denominator;
+        accumulatorPtr->fitIsValid = 1;
+    }
+    *pressureFitPtr = accumulatorPtr->fit;
+    return 0;
+}
+
+/* This function builds the direct segment index of a table, which maps the top bits of an ADC reading
+*  (adcReading >> PRESSURE_INDEX_SHIFT) straight to the first segment that can contain it. The caller 
+*  provides the storage for the index, which must hold PRESSURE_INDEX_BUCKETS(entries[0].adc, 
+*  entries[tableSize].adc) entries. Because a bucket may contain more than one table entry, a lookup 
+*  through the index is followed by a short linear step to the final segment.
+*  For a table stored in Flash, the index is generated offline with this function by the table generator.
+*  Returns the number of linear steps needed in the worst case, or -1 if the table has more segments 
+*  than can be stored in the index.
+*/
+int16_t PressureIndex_Init(PressureIndex* pressureIndexPtr, uint8_t* segments, const PressureTableEntry* entries, int16_t tableSize) {
+    const uint16_t firstBucket = entries[0].adc >> PRESSURE_INDEX_SHIFT;
+    const uint16_t bucketCount = PRESSURE_INDEX_BUCKETS(entries[0].adc, entries[tableSize].adc);
+    int16_t segment = 0;
+    int16_t maxSteps = 0;
+
+    if ((tableSize < 1) || (tableSize > UINT8_MAX)) {
+        return -1;
+    }
+    for (uint16_t bucket = 0; bucket < bucketCount; bucket++) {
+        // The first and last ADC readings of the bucket that are within the table bounds.
+        uint16_t bucketStart = (uint16_t)(firstBucket + bucket) << PRESSURE_INDEX_SHIFT;
+        uint16_t bucketEnd = bucketStart + (1 << PRESSURE_INDEX_SHIFT) - 1;
+        int16_t lastSegment;
+
+        if (bucketStart < entries[0].adc) {
+            bucketStart = entries[0].adc;
+        }
+        if (bucketEnd >= entries[tableSize].adc) {
+            bucketEnd = entries[tableSize].adc - 1;
+        }
+        // The buckets are visited in order, so the segments are found with a single pass over the table.
+        while ((segment < (tableSize - 1)) && (bucketStart >= entries[segment + 1].adc)) {
+            segment++;
+        }
+        lastSegment = segment;
+        while ((lastSegment < (tableSize - 1)) && (bucketEnd >= entries[lastSegment + 1].adc)) {
+            lastSegment++;
+        }
+        segments[bucket] = (uint8_t)segment;
+        if ((lastSegment - segment) > maxSteps) {
+            maxSteps = lastSegment - segment;
+        }
+    }
+    pressureIndexPtr->segments = segments;
+    pressureIndexPtr->firstBucket = firstBucket;
+    pressureIndexPtr->bucketCount = bucketCount;
+    return maxSteps;
+}
+
+/* This function computes the slope of every table segment, (P2 - P1) / (ADC2 - ADC1), as a fixed-point
+*  value with PRESSURE_SLOPE_SHIFT fractional bits, rounded to the nearest representable value. With
+*  the precomputed slopes the interpolation becomes one multiply and one shift, which avoids the runtime 
+*  division (costly on a microcontroller without a hardware divider) as well as the truncation of the
+*  slope to whole pressure units. The caller provides the storage, which must hold tableSize entries.
+*  For a table stored in Flash, the slopes are generated offline with this function by the table generator.
+*  Returns 0 on success and -1 if a segment's pressure step does not fit in 15 bits.
+*/
+int16_t PressureSlopes_Init(int32_t* slopes, const PressureTableEntry* entries, int16_t tableSize) {
+    for (int16_t segment = 0; segment < tableSize; segment++) {
+        int32_t pressureStep = entries[segment + 1].pressure - entries[segment].pressure;
+        int32_t adcStep = entries[segment + 1].adc - entries[segment].adc;
+        int32_t scaledStep;
+
+        if ((pressureStep >= (1L << 15)) || (pressureStep <= -(1L << 15))) {
+            return -1;
+        }
+        // (P2 - P1) * 2^16 fits in 32 bits, and adding half of the divisor rounds to the nearest value.
+        scaledStep = pressureStep * (1L << PRESSURE_SLOPE_SHIFT);
+        slopes[segment] = (scaledStep + ((scaledStep < 0) ? -(adcStep / 2) : (adcStep / 2))) / adcStep;
+    }
+    return 0;
+}
+
+/* This function builds the Eytzinger layout of the ADC readings of the table into keys and ranks, which
+*  must hold PRESSURE_EYTZINGER_SLOTS(tableSize) values. The tableSize + 1 readings are placed in a complete
+*  binary search tree of depth levels, the smallest one that holds them all, and the remaining slots are
+*  padded with UINT16_MAX, which is never less than or equal to a reading within the table bounds.
+*  The in-order rank of every slot is computed directly from its level and position in the level, so the
+*  layout is built with a single pass and no recursion.
+*  Returns the depth of the tree, or -1 if the table has fewer than 2 entries.
+*/
+int16_t PressureEytzinger_Init(PressureEytzinger* pressureEytzingerPtr, uint16_t* keys, uint16_t* ranks, const PressureTableEntry* entries, int16_t tableSize) {
+    uint8_t depth = 0;
+    uint32_t slotCount;
+
+    if (tableSize < 1) {
+        return -1;
+    }
+    while (((1UL << depth) - 1) < (uint32_t)(tableSize + 1)) {
+        depth++;
+    }
+    slotCount = 1UL << depth;
+    keys[0] = 0;
+    ranks[0] = 0;
+    for (uint32_t slot = 1, level = 0; slot < slotCount; slot++) {
+        if (slot == (2UL << level)) {
+            level++;
+        }
+        // Slot 2^level + position of a tree of the given depth holds the element of in-order rank
+        // (2 * position + 1) * 2^(depth - 1 - level) - 1.
+        uint32_t rank = ((2 * (slot - (1UL << level)) + 1) << (depth - 1 - level)) - 1;
+        keys[slot] = (rank <= (uint32_t)tableSize) ? entries[rank].adc : UINT16_MAX;
+        ranks[slot] = (uint16_t)rank;
+    }
+    pressureEytzingerPtr->keys = keys;
+    pressureEytzingerPtr->ranks = ranks;
+    pressureEytzingerPtr->depth = depth;
+    return depth;
+}
+
+/* This function returns the pressure step between consecutive entries of the table if it is the same
+*  for all of them, and 0 otherwise, including for a table of fewer than 2 entries.
+*/
+int32_t PressureTable_UniformStep(const PressureTableEntry* entries, int16_t tableSize) {
+    int32_t pressureStep;
+
+    if (tableSize < 1) {
+        return 0;
+    }
+    pressureStep = entries[1].pressure - entries[0].pressure;
+    for (int16_t i = 1; i < tableSize; i++) {
+        if ((entries[i + 1].pressure - entries[i].pressure) != pressureStep) {
+            return 0;
+        }
+    }
+    return pressureStep;
+}
+
+/* This function fills in the table descriptor used by the conversion functions, including the
+*  extrapolation fit and the detection of a uniform pressure step. It is meant to be called once per
+*  table (e.g. at start-up), and not per reading. The direct segment index and the segment slopes are
+*  optional; pass NULL to look segments up with the binary search and to interpolate with a division,
+*  respectively. For a table too large for the index, an Eytzinger layout built by
+*  PressureEytzinger_Init(...) can be attached to the eytzinger field of the descriptor afterwards.
+*/
+void PressureTable_Init(PressureTable* tablePtr, const PressureTableEntry* entries, int16_t tableSize, const PressureIndex* pressureIndexPtr, const int32_t* segmentSlopesPtr) {
+    tablePtr->entries = entries;
+    tablePtr->tableSize = tableSize;
+    PressureFit_Init(&tablePtr->fit, entries, tableSize);
+    tablePtr->index = pressureIndexPtr;
+    tablePtr->slopes = segmentSlopesPtr;
+    tablePtr->eytzinger = NULL;
+    tablePtr->pressureStep = PressureTable_UniformStep(entries, tableSize);
+    tablePtr->lut = NULL;
+}
+
+/* This function expands a filled in descriptor into its dense table: lut (PRESSURE_LUT_SIZE values) is
+*  filled in with the conversion of every 16 bit ADC reading by the descriptor, interpolation and
+*  extrapolation included, and attached to it. The conversion functions then give the same results with
+*  a single load per reading. This is meant for hosts, where the 256 KB are cheap. With instrumentation,
+*  the counters of pressureStats are left as they were, since the expansion converts no sensor reading.
+*/
+void PressureTable_InitLUT(PressureTable* tablePtr, int32_t* lut) {
+#if defined(PRESSURE_INSTRUMENTATION)
+    const PressureStats savedStats = pressureStats;
+#endif
+
+    tablePtr->lut = NULL;
+    for (uint32_t adcReading = 0; adcReading < PRESSURE_LUT_SIZE; adcReading++) {
+        lut[adcReading] = ConvertADCReadingToPressure((int)adcReading, tablePtr);
+    }
+    tablePtr->lut = lut;
+#if defined(PRESSURE_INSTRUMENTATION)
+    pressureStats = savedStats;
+#endif
+}
+
+/* This function fills in the compact form of the table, copying its ADC readings into adc (tableSize + 1
+*  values). The regular grid runs from the first to the last pressure of the table, with the step rounded
+*  down, and the difference of every pressure from it is stored in pressureResiduals (tableSize + 1
+*  values). When the pressures are exactly evenly spaced, the residuals are all zero and are left out of
+*  the compact table (pressureResiduals is NULL), so it only holds the ADC readings. The extrapolation
+*  fit, the index and the slopes are those of the original table, so the conversion results are the same.
+*  Returns 0 on success, or -1 if a residual does not fit in 16 bits.
+*/
+int16_t PressureCompactTable_Init(PressureCompactTable* tablePtr, uint16_t* adc, int16_t* pressureResiduals, const PressureTableEntry* entries, int16_t tableSize, const PressureIndex* pressureIndexPtr, const int32_t* segmentSlopesPtr) {
+    const int32_t basePressure = entries[0].pressure;
+    const int32_t pressureStep = (int32_t)(((int64_t)entries[tableSize].pressure - basePressure) / tableSize);
+    int16_t isRegular = 1;
+
+    for (int16_t i = 0; i <= tableSize; i++) {
+        int64_t residual = (int64_t)entries[i].pressure - (basePressure + (int64_t)pressureStep * i);
+
+        if ((residual < INT16_MIN) || (residual > INT16_MAX)) {
+            return -1;
+        }
+        adc[i] = entries[i].adc;
+        pressureResiduals[i] = (int16_t)residual;
+        isRegular = isRegular && (residual == 0);
+    }
+    tablePtr->adc = adc;
+    tablePtr->pressureResiduals = isRegular ? NULL : pressureResiduals;
+    tablePtr->basePressure = basePressure;
+    tablePtr->pressureStep = pressureStep;
+    tablePtr->tableSize = tableSize;
+    PressureFit_Init(&tablePtr->fit, entries, tableSize);
+    tablePtr->index = pressureIndexPtr;
+    tablePtr->slopes = segmentSlopesPtr;
+    return 0;
+}
@@ -0,0 +1,76 @@
+/***************************************************************************************************
+* Module Name: Convert Precision Sensor Readings To KPa - Hot-Swappable Calibration Tables
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This module lets a new calibration be pushed (e.g. over the bus) while the conversion ISR keeps
+*   converting readings, without locks and without masking interrupts. A table slot holds two table
+*   descriptors: the active one, used by the conversion functions, and the inactive one, which the
+*   writer fills in with the new calibration. Publishing the new descriptor is a single store of the
+*   slot generation, whose lowest bit selects the active descriptor, so a reader always sees either the
+*   old or the new table, fit and index as a whole.
+*
+*   The tables, indexes and slopes referenced by a descriptor are double-buffered by the writer in the
+*   same way. After a publish, PressureTableSlot_Inactive(...) returns the previously active descriptor,
+*   which the writer may start rewriting straight away, so a conversion must never still be using it:
+*   the readers must run on the same core as the writer, at a higher priority (e.g. the conversion ISR,
+*   with the writer in the main loop or in a lower priority bus interrupt). A conversion that picked up
+*   the previous descriptor has then completed before the preempted writer resumes.
+*
+*   Readers on other cores (e.g. the desktop worker threads), or that the writer can preempt, are not
+*   supported. Comparing the generation before and after the conversion does not make them safe: a
+*   descriptor rewritten meanwhile (e.g. the new tableSize with the old entries) can make the conversion
+*   index out of bounds before the generation is checked again.
+*
+***************************************************************************************************/
+
+#include "pressure_sensor.h"
+
+#if defined(__GNUC__)
+#define LOAD_GENERATION(slotPtr) __atomic_load_n(&(slotPtr)->generation, __ATOMIC_ACQUIRE)
+#define STORE_GENERATION(slotPtr, value) __atomic_store_n(&(slotPtr)->generation, (value), __ATOMIC_RELEASE)
+#else
+#define LOAD_GENERATION(slotPtr) ((slotPtr)->generation)
+#define STORE_GENERATION(slotPtr, value) ((slotPtr)->generation = (value))
+#endif
+
+/* This function initializes the slot with its first table descriptor, which becomes active. */
+void PressureTableSlot_Init(PressureTableSlot* slotPtr, const PressureTable* tablePtr) {
+    slotPtr->tables[0] = *tablePtr;
+    slotPtr->tables[1] = *tablePtr;
+    STORE_GENERATION(slotPtr, 0);
+}
+
+/* This function returns the descriptor currently used by the conversion functions. The caller (e.g. the
+*  conversion ISR) should read it once per conversion, or per buffer, and pass it to the conversion
+*  function, so that the whole conversion uses the same table.
+*/
+const PressureTable* PressureTableSlot_Active(const PressureTableSlot* slotPtr) {
+    return &slotPtr->tables[LOAD_GENERATION(slotPtr) & 1];
+}
+
+/* This function returns the generation of the slot, which is incremented every time a new descriptor is
+*  published. Anything derived from the active descriptor (e.g. a cached conversion) is stale as soon as
+*  the generation differs from the one it was derived with, by any amount: after a single publish, that
+*  descriptor is already the inactive one the writer fills in. This does not make readers on other cores
+*  safe (see above).
+*/
+uint8_t PressureTableSlot_Generation(const PressureTableSlot* slotPtr) {
+    return LOAD_GENERATION(slotPtr);
+}
+
+/* This function returns the inactive descriptor of the slot, for the writer to fill in with the new
+*  calibration (e.g. with PressureTable_Init(...)). It must only be called by the single writer.
+*/
+PressureTable* PressureTableSlot_Inactive(PressureTableSlot* slotPtr) {
+    return &slotPtr->tables[(LOAD_GENERATION(slotPtr) & 1) ^ 1];
+}
+
+/* This function makes the inactive descriptor active, with a single store. The descriptor (and the data
+*  it references) is written before the store is visible to the readers.
+*/
+void PressureTableSlot_Publish(PressureTableSlot* slotPtr) {
+    STORE_GENERATION(slotPtr, (uint8_t)(LOAD_GENERATION(slotPtr) + 1));
+}
@@ -1,275 +1,284 @@
 /***************************************************************************************************
-* Module Name: Convert Precision Sensor Readings To KPa
+* Module Name: Convert Precision Sensor Readings To KPa - Desktop Test Program
 *
 * Author: Hooman Tahmasebipour
 * Date: September, 2023
 *
 * Module Description:
-*   This module provides the functionality to convert ADC readings from a precision sensor into pressure 
-*   values based on a given  mapping. The primary consideration of this module was the resource constrained 
-*   nature of its application.
+*   This program exercises the conversion functions of pressure_sensor.c in a desktop environment, by
+*   converting the ADC readings entered by the operator with the generated Pressure-ADC table. It can
+*   also convert whole ADC logs non-interactively (see pressure_stream.c), or run as the daemon that
+*   converts the frames of many sensors streaming over UDP and serial ports (see pressure_daemon.c).
 *
 ***************************************************************************************************/
 
+#include <signal.h>
 #include <stdio.h>
-#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
-// Variable definitions that, in the microcontroller environment, would be stored in 
-// Flash memory to limit RAM usage.
-typedef struct {
-    // Pressure is multiplied by FIXED_POINT_ARITH to avoid floating point. Using a 32 bit int for this to 
-    // prevent bit overflow with the nominal 16 bit int in the microcontroller. Directly specifying this rather
-    // than long for easier readibility.
-    int32_t pressure;
-    uint16_t adc;
-} PressureTableEntry;
+#include "pressure_calibration.h"
+#include "pressure_daemon.h"
+#include "pressure_sensor.h"
+#include "pressure_stream.h"
+// The Pressure-ADC table and the data precomputed from it are generated from the calibration CSV at
+// build time (see "make table"). All of it is made of compile-time constants stored in Flash memory.
+#include "pressure_table.h"
 
-static PressureTableEntry pressureTable[] = {
-    {  10000, 1696  },
-    {  11000, 1909  },
-    {  12000, 2118  },
-    {  13000, 2272  },
-    {  14000, 2366  },
-    {  15000, 2448  },
-    {  16000, 2570  },
-    {  17000, 2745  },
-    {  18000, 2931  },
-    {  19000, 3073  },
-    {  20000, 3151  },
-    {  21000, 3200  },
-    {  22000, 3278  },
-    {  23000, 3411  },
-    {  24000, 3573  },
-    {  25000, 3706  },
-    {  26000, 3777  },
-    {  27000, 3808  },
-    {  28000, 3853  },
-    {  29000, 3955  },
-    {  30000, 4100  },
-    {  31000, 4236  },
-    {  32000, 4316  },
-    {  33000, 4348  },
-    {  34000, 4382  },
-    {  35000, 4468  },
-    {  36000, 4610  },
-    {  37000, 4762  },
-    {  38000, 4871  },
-    {  39000, 4927  },
-    {  40000, 4971  },
-    {  41000, 5058  },
-    {  42000, 5210  },
-    {  43000, 5390  },
-    {  44000, 5541  },
-    {  45000, 5639  },
-    {  46000, 5710  },
-    {  47000, 5812  },
-    {  48000, 5979  },
-    {  49000, 6190  },
-    {  50000, 6389  },
-    {  51000, 6534  },
-    {  52000, 6641  },
-    {  53000, 6762  },
-    {  54000, 6943  },
-    {  55000, 7177  },
-    {  56000, 7414  },
-    {  57000, 7604  },
-    {  58000, 7743  },
-    {  59000, 7877  },
-    {  60000, 8060  },
-    {  61000, 8302  },
-    {  62000, 8560  },
-    {  63000, 8778  },
-    {  64000, 8938  },
-    {  65000, 9074  },
-    {  66000, 9243  },
-    {  67000, 9470  },
-    {  68000, 9726  },
-    {  69000, 9954  },
-    {  70000, 10119 },
-    {  71000, 10244 },
-    {  72000, 10383 },
-    {  73000, 10577 },
-    {  74000, 10810 },
-    {  75000, 11028 },
-    {  76000, 11187 },
-    {  77000, 11292 },
-    {  78000, 11394 },
-    {  79000, 11542 },
-    {  80000, 11739 },
-    {  81000, 11937 },
-    {  82000, 12085 },
-    {  83000, 12170 },
-    {  84000, 12237 },
-    {  85000, 12340 },
-    {  86000, 12498 },
-    {  87000, 12675 },
-    {  88000, 12815 },
-    {  89000, 12893 },
-    {  90000, 12938 },
-    {  91000, 13007 },
-    {  92000, 13135 },
-    {  93000, 13299 },
-    {  94000, 13444 },
-    {  95000, 13531 },
-    {  96000, 13575 },
-    {  97000, 13631 },
-    {  98000, 13744 },
-    {  99000, 13908 },
-    { 100000, 14073 },
-};
-
-// Macro definitions for meeting the 
-#define FIXED_POINT_ARITH 100
-#define PRESSURE_TABLE_PTR &pressureTable
 /* Note : When running the function in the microcontroller environment, change the below macro 
-          definition to equal the memory address reserved in Flash memory for pressure table, as 
-          discussed in points 2 and 3. */
-#define TABLE_SIZE (sizeof(pressureTable) / sizeof(pressureTable[0])) - 1
+          definition to equal the memory address reserved in Flash memory for the descriptor of the
+          pressure table, as discussed in points 2 and 3. */
+#define PRESSURE_TABLE_PTR &pressureTableDescriptor
+
+/* Converts the ADC readings entered by the operator, until a negative number is entered. */
+static int RunInteractive(const PressureTable* tablePtr) {
+    int adcReading = 0;
+    printf("Enter the ADC Sensor Readings to convert to pressure readings with a precision of 0.01 KPa, one per line.\n");
+    printf("Divide the pressure readings by %d to get the decimal result with 0.01 KPa precision.\n", FIXED_POINT_ARITH);
+    printf("To exit the program, enter a negative number.\n\n");
+    int res = scanf("%d", &adcReading);
+    if (res != 1) {
+        printf("Error occured with scanf operation.");
+        return -1;
+    }
+    // Note, we know that the ADC Reading is an unsigned integer. Thus, a value of -1 is not possible 
+    // and can be used as a stopping condition.
+    while (adcReading >= 0) {
+        int pressureReading = ConvertADCReadingToPressure(adcReading, tablePtr);
+        printf("ADC Reading: %d, Pressure Reading: %d \n", adcReading, pressureReading);
+        res = scanf("%d", &adcReading);
+        if (res != 1) {
+            printf("Error occured with scanf operation.");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Converts a whole ADC log from a file (or stdin) to a file (or stdout), writing only the results. */
+static int RunStream(const char* inputPath, const char* outputPath, PressureStreamFormat inputFormat, PressureStreamFormat outputFormat,
+                     const PressureTable* tablePtr) {
+    FILE* in = stdin;
+    FILE* out = stdout;
+    int result;
 
-/* This function will follow the below algorithm steps:
-*   1. Determine if the ADC sensor reading to convert to a pressure value is within the bounds 
-*      of the saved Presure to ADC Sensor Reading table. 
-*   2. If it is, then either the entry will be found directly or interpolation will be used to 
-*      determine the appropriate pressure reading associated with the ADC reading.
-*        2a. Prior to performing the interpolation, a binary search is performed to either
-*            find the entry directly our find the (P1, ADC1) and (P2, ADC2) that are closest to it.
-*            This occurs when (int) ((searchWindowEnd - searchWindowStart) / 2) == 0. In performing
-*            this, we are taking advantage of the fact that integer division always rounds down in C
-*            programming.
-*        2b. The next step would be to perform the interpolation using the following formula.
-*              Interpolation formula: m = (P2 - P1)/(ADC2 - ADC1) => P = P1 + m * (ADC - ADC1)
-*                Where, (P1, ADC1) and (P2, ADC2) are the two Pressure-ADCSensor
-*                mapping pairs closest to the provided reading, ADC is the provided sensor reading
-*                value, and P is the output pressure reading.
-*   3. If it is not, then first a least-squares approximation method is used to arrive at a linear fit 
-*      for the saved data. The resulting slope and y-intercept values are then used to extrapolate
-*      for the appropriate pressure reading given the input ADC reading.
-*           Least Squares minimization to arrive at equations for the slope (m) and y-intercept (b),
-*           result in the following formulae:
-*               m = (N * sum(ADC_i * P_i) - sum(ADC_i) * sum(P_i)) / N * sum(ADC_i^2) - (sum(ADC_i))^2
-*               b = (sum(ADC_i^2) * sum(P_i) - sum(ADC_i) * sum(ADC_i * P_i)) / N * sum(ADC_i^2) - (sum(ADC_i))^2
-*           Where N is the total number of data points in the available data set, ADC_i is ADC reading
-*           element i in the data set, P_i is Pressure reading i in the data set, and sum(x) denotes 
-*           the summation of expression x across all values of ADC_i and/or P_i for i = 0, ..., N.
-*    
-*   IMPORTANT: The below function provides a method for extrapolation which requires 64-bit integers.
-*              If this variable type does not exist in the microcontroller environment, then extrapolation
-*              is not possible.
+    if ((inputPath != NULL) && (strcmp(inputPath, "-") != 0)) {
+        in = fopen(inputPath, (inputFormat == PRESSURE_STREAM_BINARY) ? "rb" : "r");
+        if (in == NULL) {
+            fprintf(stderr, "%s: cannot open the ADC log.\n", inputPath);
+            return -1;
+        }
+    }
+    if ((outputPath != NULL) && (strcmp(outputPath, "-") != 0)) {
+        out = fopen(outputPath, (outputFormat == PRESSURE_STREAM_BINARY) ? "wb" : "w");
+        if (out == NULL) {
+            fprintf(stderr, "%s: cannot create the output file.\n", outputPath);
+            if (in != stdin) {
+                fclose(in);
+            }
+            return -1;
+        }
+    }
+    result = PressureStream_Convert(in, out, inputFormat, outputFormat, tablePtr);
+    if (in != stdin) {
+        fclose(in);
+    }
+    if ((out != stdout) && (fclose(out) != 0)) {
+        fprintf(stderr, "%s: error occured while writing the output file.\n", outputPath);
+        result = -1;
+    }
+    return result;
+}
+
+// The daemon holds the reassembly buffers of all of its sources, which are too large for the stack, and
+// is stopped from the signal handler.
+static PressureDaemon sensorDaemon;
+
+static void StopDaemon(int signalNumber) {
+    (void)signalNumber;
+    PressureDaemon_Stop(&sensorDaemon);
+}
+
+/* Runs the multi-sensor daemon with the --udp, --serial and --sensor options of the command line, until
+*  every serial stream has ended (with no UDP port) or SIGINT or SIGTERM is received.
 */
-int ConvertADCReadingToPressure(int adcReading, PressureTableEntry* pressureTablePtr) {
-    // Total amount of RAM used by run-time variables: 24 Bytes
-    // NOTE: The pressureTable size is not included since running this function in the microcontroller 
-    //       use-case allows for this table to be be allocated in Flash memory. Further explanations
-    //       are in points 2 and 3 under the heading "Developer Notes".
-    
-    int32_t pressure = 0;
+static int RunDaemon(int argc, char* argv[], const char* outputPath, const PressureTable* defaultTablePtr) {
+    PressureTable* sensorTables[PRESSURE_DAEMON_MAX_SENSORS];
+    uint16_t sensorTableCount = 0;
+    FILE* out = stdout;
+    int result = 0;
 
-    if ((adcReading >= pressureTablePtr[0].adc) && (adcReading <= pressureTablePtr[TABLE_SIZE].adc)) {
-        // The Pressure reading can either be found in the table or can be interpolated.
-        // To find the pressure reading in the table, we perform a binary search by taking
-        // advantage of the sorted nature of the table and optimize the program for speed.
-        
-        int16_t searchWindowStart = 0;
-        int16_t searchWindowEnd = TABLE_SIZE;
-        int16_t midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
-        int16_t readingFound = 0;
-        int32_t P1, P2;
-        uint16_t ADC1, ADC2;
-        
-        // First check the first and last element of the table, if the ADC Reading is found, 
-        // return the associated Pressure reading.
-        if (adcReading == pressureTablePtr[0].adc) {
-            readingFound = 1;
-            pressure = pressureTablePtr[0].pressure;
+    if ((outputPath != NULL) && (strcmp(outputPath, "-") != 0)) {
+        out = fopen(outputPath, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "%s: cannot create the output file.\n", outputPath);
+            return -1;
         }
-        else if (adcReading == pressureTablePtr[TABLE_SIZE].adc) {
-            readingFound = 1;
-            pressure = pressureTablePtr[TABLE_SIZE].pressure;
+    }
+    fflush(out);
+    PressureDaemon_Init(&sensorDaemon, fileno(out), defaultTablePtr);
+
+    for (int i = 1; (i < argc) && (result == 0); i++) {
+        if ((strcmp(argv[i], "--udp") == 0) && ((i + 1) < argc)) {
+            unsigned long port = strtoul(argv[++i], NULL, 10);
+            result = ((port > 0) && (port <= UINT16_MAX)) ? PressureDaemon_AddUDP(&sensorDaemon, (uint16_t)port) : -1;
         }
-        else {
-            // The requested ADC Reading was not there, so perform a binary search
-            while (readingFound == 0) {
-                if (adcReading == pressureTablePtr[midPoint].adc) {
-                    readingFound = 1;
-                    pressure = pressureTablePtr[midPoint].pressure;
-                }
-                else if (midPoint == searchWindowStart) {
-                    // The entries surrounding the input ADC Reading have been found.
-                    // Use the interpolation formula to output the Pressur Reading
-                    readingFound = 1;
-                    P1 = pressureTablePtr[searchWindowStart].pressure;
-                    P2 = pressureTablePtr[searchWindowEnd].pressure;
-                    ADC1 = pressureTablePtr[searchWindowStart].adc;
-                    ADC2 = pressureTablePtr[searchWindowEnd].adc;
-                    pressure = P1 + ((P2 - P1) / (ADC2 - ADC1)) * (adcReading - ADC1);
-                }
-                else if (adcReading < pressureTablePtr[midPoint].adc) {
-                    // The ADC Reading is in the first half of the search window
-                    searchWindowEnd = midPoint;
-                    midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+        else if ((strcmp(argv[i], "--serial") == 0) && ((i + 1) < argc)) {
+            result = PressureDaemon_AddStream(&sensorDaemon, argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--sensor") == 0) && ((i + 1) < argc)) {
+            char* separator;
+            unsigned long id = strtoul(argv[++i], &separator, 10);
+            if ((*separator != '=') || (id > UINT16_MAX) || (sensorTableCount == PRESSURE_DAEMON_MAX_SENSORS)) {
+                fprintf(stderr, "%s: expected <sensor ID>=<calibration.csv>, for at most %d sensors.\n", argv[i], PRESSURE_DAEMON_MAX_SENSORS);
+                result = -1;
+            }
+            else {
+                sensorTables[sensorTableCount] = PressureCalibration_Load(separator + 1);
+                if (sensorTables[sensorTableCount] == NULL) {
+                    result = -1;
                 }
-                else if (adcReading > pressureTablePtr[midPoint].adc) {
-                    // The ADC Reading is in the second half of the search window
-                    searchWindowStart = midPoint;
-                    midPoint = searchWindowStart + (searchWindowEnd - searchWindowStart) / 2;
+                else {
+                    PressureDaemon_AddSensor(&sensorDaemon, (uint16_t)id, sensorTables[sensorTableCount++]);
                 }
             }
         }
     }
-    else {
-        // The Pressure reading must be extrapolated. 
-        // NOTE: To prevent bit overflow with the provided data set, either 64-bit integer types are needed 
-        //       for Fixed-Point arithmetic operations or SW/HW level floating point support is needed for 
-        //       the 32-bit float data type. 
-        int64_t sumOfADC_iTimesP_i = 0;
-        int64_t sumOfADC_i = 0;
-        int64_t sumOfP_i = 0;
-        int64_t sumOfADC_iSquared = 0;
-        
-        for (int16_t i = 0; i <= TABLE_SIZE; i++) {
-            sumOfADC_iTimesP_i = sumOfADC_iTimesP_i + pressureTablePtr[i].adc * (pressureTablePtr[i].pressure / FIXED_POINT_ARITH);
-            sumOfADC_i = sumOfADC_i + pressureTablePtr[i].adc;
-            sumOfP_i = sumOfP_i + pressureTablePtr[i].pressure / FIXED_POINT_ARITH;
-            sumOfADC_iSquared = sumOfADC_iSquared + pressureTablePtr[i].adc * pressureTablePtr[i].adc;
-        }
-        sumOfADC_iTimesP_i = sumOfADC_iTimesP_i / TABLE_SIZE;
-        sumOfADC_i = sumOfADC_i / TABLE_SIZE;
-        sumOfP_i = sumOfP_i / TABLE_SIZE;
-        sumOfADC_iSquared = sumOfADC_iSquared / TABLE_SIZE;
-        int64_t slope = (sumOfADC_iTimesP_i - sumOfADC_i * sumOfP_i) * FIXED_POINT_ARITH / (sumOfADC_iSquared - sumOfADC_i * sumOfADC_i);
-        int64_t intercept = (sumOfADC_iSquared * sumOfP_i - sumOfADC_i * sumOfADC_iTimesP_i) * FIXED_POINT_ARITH / (sumOfADC_iSquared - sumOfADC_i * sumOfADC_i);
-        pressure = slope * adcReading + intercept;
+    if (result == 0) {
+        signal(SIGINT, StopDaemon);
+        signal(SIGTERM, StopDaemon);
+        result = PressureDaemon_Run(&sensorDaemon);
+        fprintf(stderr, "%llu frames (%llu samples) converted in %llu batches, %llu frames dropped, %llu bytes skipped.\n",
+                (unsigned long long)sensorDaemon.frames, (unsigned long long)sensorDaemon.samples, (unsigned long long)sensorDaemon.batches,
+                (unsigned long long)sensorDaemon.droppedFrames, (unsigned long long)sensorDaemon.skippedBytes);
+    }
+    while (sensorTableCount > 0) {
+        free(sensorTables[--sensorTableCount]);
     }
-    return pressure;
+    if ((out != stdout) && (fclose(out) != 0)) {
+        fprintf(stderr, "%s: error occured while writing the output file.\n", outputPath);
+        result = -1;
+    }
+    return result;
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Usage: %s                 Convert the ADC readings entered by the operator\n", program);
+    fprintf(stderr, "       %s --stream [--binary-input] [--binary-output] [-o <output>] [<input>]\n", program);
+    fprintf(stderr, "           Convert a whole ADC log (stdin by default) to stdout or <output>. The input holds\n");
+    fprintf(stderr, "           one decimal ADC reading per line, or raw little-endian uint16 samples with\n");
+    fprintf(stderr, "           --binary-input. The output holds one pressure reading per line, or raw \n");
+    fprintf(stderr, "           little-endian int32 pressures with --binary-output.\n");
+    fprintf(stderr, "       %s --stream --mmap [--threads <count>] -o <output> <input>\n", program);
+    fprintf(stderr, "           Convert a raw capture of little-endian uint16 samples into raw little-endian\n");
+    fprintf(stderr, "           int32 pressures, with both files memory-mapped, using <count> worker threads\n");
+    fprintf(stderr, "           (1 by default, 0 for one per CPU).\n");
+    fprintf(stderr, "       %s --daemon [--udp <port>]... [--serial <path>]... [--sensor <id>=<calibration.csv>]...\n", program);
+    fprintf(stderr, "                  [--drop-unknown] [-o <output>]\n");
+    fprintf(stderr, "           Convert the ADC frames of many sensors, received on UDP ports and serial streams\n");
+    fprintf(stderr, "           (\"-\" for stdin), into pressure frames written to stdout or <output>, with the\n");
+    fprintf(stderr, "           table of the calibration CSV of every sensor, and the generated table for the\n");
+    fprintf(stderr, "           other sensors unless --drop-unknown is given. Runs until the serial streams end,\n");
+    fprintf(stderr, "           or until interrupted when receiving on a UDP port.\n");
+    fprintf(stderr, "       --lut  Convert through the dense table of every ADC reading (256 KB), in any mode.\n");
 }
 
 /* 
 * The main function contains the test code to exercise the ConvertADCReadingToPressure function. 
-* It will continue running until -1 is entered by the operator. Since this code is not intended 
-* for execution in the microcontroller environment, but rather on a Windows desktop, the same 
-* level of precautions for limiting resource usage is not maintained. However, to follow best 
+* Without arguments, it will continue running until -1 is entered by the operator. With --stream, it
+* converts a whole ADC log in large blocks instead, e.g. to reprocess raw logs offline. Since this code 
+* is not intended for execution in the microcontroller environment, but rather on a Windows desktop, the 
+* same level of precautions for limiting resource usage is not maintained. However, to follow best 
 * practices the software was written to be as efficient in time/complexity as possible.
 */
-int main() {
-    int adcReading = 0;
-    printf("Enter the ADC Sensor Reading to convert to a pressure reading with a precision of 0.01 KPa: \n");
-    int res = scanf("%d", &adcReading);
-    if (res != 1) {
-        printf("Error occured with scanf operation.");
+int main(int argc, char* argv[]) {
+    PressureStreamFormat inputFormat = PRESSURE_STREAM_TEXT;
+    PressureStreamFormat outputFormat = PRESSURE_STREAM_TEXT;
+    const char* inputPath = NULL;
+    const char* outputPath = NULL;
+    int streamMode = 0;
+    int daemonMode = 0;
+    int daemonOptions = 0;
+    int dropUnknown = 0;
+    int mappedFiles = 0;
+    unsigned threadCount = 1;
+    int threadOptions = 0;
+    int fullLUT = 0;
+    const PressureTable* tablePtr = PRESSURE_TABLE_PTR;
+    PressureTable lutTable;
+    int32_t* lut = NULL;
+    int result;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream") == 0) {
+            streamMode = 1;
+        }
+        else if (strcmp(argv[i], "--daemon") == 0) {
+            daemonMode = 1;
+        }
+        else if (((strcmp(argv[i], "--udp") == 0) || (strcmp(argv[i], "--serial") == 0) || (strcmp(argv[i], "--sensor") == 0)) && ((i + 1) < argc)) {
+            // Applied in order by RunDaemon(...).
+            daemonOptions = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--drop-unknown") == 0) {
+            daemonOptions = 1;
+            dropUnknown = 1;
+        }
+        else if (strcmp(argv[i], "--mmap") == 0) {
+            mappedFiles = 1;
+        }
+        else if ((strcmp(argv[i], "--threads") == 0) && ((i + 1) < argc)) {
+            // Only the memory-mapped conversion runs on worker threads.
+            threadOptions = 1;
+            threadCount = (unsigned)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--lut") == 0) {
+            fullLUT = 1;
+        }
+        else if (strcmp(argv[i], "--binary-input") == 0) {
+            inputFormat = PRESSURE_STREAM_BINARY;
+        }
+        else if (strcmp(argv[i], "--binary-output") == 0) {
+            outputFormat = PRESSURE_STREAM_BINARY;
+        }
+        else if ((strcmp(argv[i], "-o") == 0) && ((i + 1) < argc)) {
+            outputPath = argv[++i];
+        }
+        else if ((inputPath == NULL) && ((argv[i][0] != '-') || (strcmp(argv[i], "-") == 0))) {
+            inputPath = argv[i];
+        }
+        else {
+            PrintUsage(argv[0]);
+            return -1;
+        }
+    }
+    if ((!streamMode && !daemonMode && (argc > (1 + fullLUT))) || (mappedFiles && ((inputPath == NULL) || (outputPath == NULL)))
+        || (daemonMode && (streamMode || (inputPath != NULL))) || (daemonOptions && !daemonMode) || (threadOptions && !mappedFiles)) {
+        PrintUsage(argv[0]);
         return -1;
     }
-    // Note, we know that the ADC Reading is an unsigned integer. Thus, a value of -1 is not possible 
-    // and can be used as a stopping condition.
-    while (adcReading >= 0) {
-        int pressureReading = ConvertADCReadingToPressure(adcReading, PRESSURE_TABLE_PTR);
-        printf("ADC Reading: %d, Pressure Reading: %d \n", adcReading, pressureReading);
-        printf("Divide above pressure reading by %d to get the decimal result with 0.01 KPa precision.\n\n", FIXED_POINT_ARITH);
-        printf("To exit the program, enter a negative number. Otherwise, enter another number to convert to a pressure reading: \n");
-        res = scanf("%d", &adcReading);
-        if (res != 1) {
-            printf("Error occured with scanf operation.");
+    if (fullLUT) {
+        // The descriptor is copied to RAM to attach its dense table. The conversion functions use it
+        // without any other change.
+        lut = malloc(PRESSURE_LUT_SIZE * sizeof(*lut));
+        if (lut == NULL) {
+            fprintf(stderr, "Cannot allocate the dense table.\n");
             return -1;
         }
+        lutTable = *tablePtr;
+        PressureTable_InitLUT(&lutTable, lut);
+        tablePtr = &lutTable;
     }
-    return 0;
+    if (daemonMode) {
+        result = RunDaemon(argc, argv, outputPath, dropUnknown ? NULL : tablePtr);
+    }
+    else if (mappedFiles) {
+        result = PressureStream_ConvertMappedFile(inputPath, outputPath, tablePtr, threadCount);
+    }
+    else {
+        result = streamMode ? RunStream(inputPath, outputPath, inputFormat, outputFormat, tablePtr) : RunInteractive(tablePtr);
+    }
+    free(lut);
+    return result;
 }
\ No newline at end of file
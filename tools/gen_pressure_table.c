@@ -0,0 +1,377 @@
+/***************************************************************************************************
+* Module Name: Pressure-ADC Table Generator
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This desktop tool turns a calibration CSV into a C header holding the Pressure-ADC table and all
+*   the data precomputed from it (extrapolation fit, direct segment index, segment slopes, compact form
+*   of the table and, for large tables, the Eytzinger layout of the ADC readings) as
+*   compile-time constants placed in Flash memory. This removes all start-up computation from the
+*   microcontroller, and lets a calibrated variant of the sensor be shipped by regenerating the header
+*   rather than editing the source code.
+*
+*   Usage: gen_pressure_table [--name <table symbol>] [--eytzinger]
+*                             [--poly-max-error <error> [--poly-degree <degree>] [--poly-min-ratio <ratio>]]
+*                             <calibration.csv> > pressure_table.h
+*
+*   The Eytzinger layout is generated when the table is too large for the direct segment index, or when
+*   requested with --eytzinger.
+*
+*   With --poly-max-error, the piecewise-polynomial form of the table is also generated (see tools/poly_fit.c),
+*   with polynomials of the given degree (1 to 3, 3 by default) converting every ADC reading within the
+*   table bounds at most <error> (in 0.01 KPa) away from the table. With --poly-min-ratio, the generation
+*   fails unless the piecewise-polynomial form (coefficients and segment bounds) is at least <ratio> times
+*   smaller than the table entries, e.g. to check that a calibration is smooth enough to be replaced by it.
+*
+*   The CSV holds one "pressure_kpa,adc" row per table entry, sorted by strictly increasing ADC reading.
+*   The pressure may have up to 2 decimals (0.01 KPa precision). Blank lines, lines starting with '#'
+*   and a header row are ignored.
+*
+***************************************************************************************************/
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pressure_calibration.h"
+#include "pressure_sensor.h"
+#include "poly_fit.h"
+
+#define MAX_TABLE_ENTRIES PRESSURE_CALIBRATION_MAX_ENTRIES
+#define MAX_NAME_LENGTH 64
+
+/* Converts the camelCase table symbol into the UPPER_SNAKE_CASE prefix of its macros. */
+static void MacroPrefix(const char* name, char* prefix) {
+    size_t length = 0;
+
+    for (const char* c = name; (*c != '\0') && (length < (MAX_NAME_LENGTH * 2 - 2)); c++) {
+        if (isupper((unsigned char)*c) && (c != name)) {
+            prefix[length++] = '_';
+        }
+        prefix[length++] = (char)toupper((unsigned char)*c);
+    }
+    prefix[length] = '\0';
+}
+
+static int IsValidName(const char* name) {
+    if ((strlen(name) == 0) || (strlen(name) >= MAX_NAME_LENGTH) || !(isalpha((unsigned char)name[0]) || (name[0] == '_'))) {
+        return 0;
+    }
+    for (const char* c = name; *c != '\0'; c++) {
+        if (!isalnum((unsigned char)*c) && (*c != '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void EmitHeader(const char* name, const char* csvPath, const PressureTableEntry* entries, int16_t tableSize,
+                       const PressureFit* fit, const PressureIndex* index, const int32_t* slopes, const PressureEytzinger* eytzinger,
+                       const PressureCompactTable* compact, const PressurePolyTable* poly, int32_t polyError) {
+    char prefix[MAX_NAME_LENGTH * 2];
+    MacroPrefix(name, prefix);
+
+    printf("/* Generated by tools/gen_pressure_table from %s. Do not edit, regenerate with \"make table\". */\n\n", csvPath);
+    printf("#ifndef %s_H\n#define %s_H\n\n", prefix, prefix);
+    printf("#include \"pressure_sensor.h\"\n\n");
+    printf("#if (PRESSURE_INDEX_SHIFT != %d) || (PRESSURE_SLOPE_SHIFT != %d)\n", PRESSURE_INDEX_SHIFT, PRESSURE_SLOPE_SHIFT);
+    printf("#error \"%s was generated with a different fixed-point format, regenerate it with \\\"make table\\\"\"\n", name);
+    printf("#endif\n\n");
+    printf("// Index of the last entry in %s.\n", name);
+    printf("#define %s_SIZE %d\n\n", prefix, tableSize);
+
+    printf("// Entries of %s as an X-macro list of (pressure, adc), which also makes them available to\n", name);
+    printf("// compile-time code (e.g. pressure_converter.hpp).\n");
+    printf("#define %s_ENTRIES(ENTRY) \\\n", prefix);
+    for (int16_t i = 0; i <= tableSize; i++) {
+        printf("    ENTRY(%6" PRId32 ", %6u)%s\n", entries[i].pressure, entries[i].adc, (i < tableSize) ? " \\" : "");
+    }
+    printf("\n");
+    printf("static const PressureTableEntry %s[] PRESSURE_FLASH_DATA = {\n", name);
+    printf("    %s_ENTRIES(PRESSURE_TABLE_ENTRY)\n", prefix);
+    printf("};\n\n");
+
+    printf("// Least-squares fit of %s, used for extrapolation.\n", name);
+    printf("static const PressureFit %sFit PRESSURE_FLASH_DATA = { INT64_C(%" PRId64 "), INT64_C(%" PRId64 ") };\n\n",
+           name, fit->slope, fit->intercept);
+
+    if (slopes != NULL) {
+        printf("// Fixed-point slope of every %s segment, with PRESSURE_SLOPE_SHIFT fractional bits.\n", name);
+        printf("static const int32_t %sSlopes[] PRESSURE_FLASH_DATA = {\n", name);
+        for (int16_t i = 0; i < tableSize; i++) {
+            printf("%s%8" PRId32 ",%s", ((i % 8) == 0) ? "   " : "", slopes[i], (((i % 8) == 7) || (i == (tableSize - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+    }
+
+    if (index != NULL) {
+        printf("// Direct segment index of %s, keyed on adcReading >> PRESSURE_INDEX_SHIFT (%d).\n", name, PRESSURE_INDEX_SHIFT);
+        printf("static const uint8_t %sIndexSegments[] PRESSURE_FLASH_DATA = {\n", name);
+        for (uint16_t i = 0; i < index->bucketCount; i++) {
+            printf("%s%4u,%s", ((i % 16) == 0) ? "   " : "", index->segments[i], (((i % 16) == 15) || (i == (index->bucketCount - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+        printf("static const PressureIndex %sIndex PRESSURE_FLASH_DATA = { %sIndexSegments, %u, %u };\n\n",
+               name, name, index->firstBucket, index->bucketCount);
+    }
+
+    if (eytzinger != NULL) {
+        uint32_t slotCount = 1UL << eytzinger->depth;
+
+        printf("// Eytzinger layout of the ADC readings of %s (slot 0 unused, padded with UINT16_MAX).\n", name);
+        printf("static const uint16_t %sEytzingerKeys[] PRESSURE_FLASH_DATA = {\n", name);
+        for (uint32_t i = 0; i < slotCount; i++) {
+            printf("%s%6u,%s", ((i % 12) == 0) ? "   " : "", eytzinger->keys[i], (((i % 12) == 11) || (i == (slotCount - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+        printf("static const uint16_t %sEytzingerRanks[] PRESSURE_FLASH_DATA = {\n", name);
+        for (uint32_t i = 0; i < slotCount; i++) {
+            printf("%s%6u,%s", ((i % 12) == 0) ? "   " : "", eytzinger->ranks[i], (((i % 12) == 11) || (i == (slotCount - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+        printf("static const PressureEytzinger %sEytzinger PRESSURE_FLASH_DATA = { %sEytzingerKeys, %sEytzingerRanks, %u };\n\n",
+               name, name, name, eytzinger->depth);
+    }
+
+    printf("// Descriptor of %s for the conversion functions.\n", name);
+    printf("static const PressureTable %sDescriptor PRESSURE_FLASH_DATA = {\n", name);
+    printf("    %s,\n    %s_SIZE,\n    { INT64_C(%" PRId64 "), INT64_C(%" PRId64 ") },\n", name, prefix, fit->slope, fit->intercept);
+    if (index != NULL) {
+        printf("    &%sIndex,\n", name);
+    }
+    else {
+        printf("    NULL,\n");
+    }
+    if (slopes != NULL) {
+        printf("    %sSlopes,\n", name);
+    }
+    else {
+        printf("    NULL,\n");
+    }
+    if (eytzinger != NULL) {
+        printf("    &%sEytzinger,\n", name);
+    }
+    else {
+        printf("    NULL,\n");
+    }
+    printf("    %" PRId32 ",\n", PressureTable_UniformStep(entries, tableSize));
+    printf("    NULL\n");
+    printf("};\n\n");
+    if (compact != NULL) {
+        printf("// Compact form of %s: pressure i is %" PRId32 " + %" PRId32 " * i%s.\n", name, compact->basePressure, compact->pressureStep,
+               (compact->pressureResiduals != NULL) ? " + residual i" : "");
+        printf("static const uint16_t %sCompactADC[] PRESSURE_FLASH_DATA = {\n", name);
+        for (int16_t i = 0; i <= tableSize; i++) {
+            printf("%s%6u,%s", ((i % 12) == 0) ? "   " : "", compact->adc[i], (((i % 12) == 11) || (i == tableSize)) ? "\n" : "");
+        }
+        printf("};\n\n");
+        if (compact->pressureResiduals != NULL) {
+            printf("static const int16_t %sCompactResiduals[] PRESSURE_FLASH_DATA = {\n", name);
+            for (int16_t i = 0; i <= tableSize; i++) {
+                printf("%s%6d,%s", ((i % 12) == 0) ? "   " : "", compact->pressureResiduals[i], (((i % 12) == 11) || (i == tableSize)) ? "\n" : "");
+            }
+            printf("};\n\n");
+        }
+        printf("static const PressureCompactTable %sCompact PRESSURE_FLASH_DATA = {\n", name);
+        printf("    %sCompactADC,\n", name);
+        if (compact->pressureResiduals != NULL) {
+            printf("    %sCompactResiduals,\n", name);
+        }
+        else {
+            printf("    NULL,\n");
+        }
+        printf("    %" PRId32 ",\n    %" PRId32 ",\n    %s_SIZE,\n", compact->basePressure, compact->pressureStep, prefix);
+        printf("    { INT64_C(%" PRId64 "), INT64_C(%" PRId64 ") },\n", fit->slope, fit->intercept);
+        if (index != NULL) {
+            printf("    &%sIndex,\n", name);
+        }
+        else {
+            printf("    NULL,\n");
+        }
+        if (slopes != NULL) {
+            printf("    %sSlopes\n", name);
+        }
+        else {
+            printf("    NULL\n");
+        }
+        printf("};\n\n");
+    }
+
+    if (poly != NULL) {
+        uint32_t coefficientCount = (uint32_t)poly->segmentCount * (poly->degree + 1u);
+
+        printf("#if PRESSURE_POLY_COEFFICIENT_SHIFT != %d\n", PRESSURE_POLY_COEFFICIENT_SHIFT);
+        printf("#error \"%sPoly was generated with a different fixed-point format, regenerate it\"\n", name);
+        printf("#endif\n\n");
+        printf("#define %s_HAS_POLY 1\n", prefix);
+        printf("#define %s_POLY_MAX_ERROR %" PRId32 "\n\n", prefix, polyError);
+        printf("// Piecewise-polynomial form of %s: %u segments of degree %u, at most %" PRId32 " (0.01 KPa) away from the\n",
+               name, poly->segmentCount, poly->degree, polyError);
+        printf("// table. First ADC reading and position shift of every segment.\n");
+        printf("static const uint16_t %sPolySegmentStarts[] PRESSURE_FLASH_DATA = {\n", name);
+        for (uint16_t i = 0; i < poly->segmentCount; i++) {
+            printf("%s%6u,%s", ((i % 12) == 0) ? "   " : "", poly->segmentStarts[i], (((i % 12) == 11) || (i == (poly->segmentCount - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+        printf("static const uint8_t %sPolySegmentShifts[] PRESSURE_FLASH_DATA = {\n", name);
+        for (uint16_t i = 0; i < poly->segmentCount; i++) {
+            printf("%s%3u,%s", ((i % 16) == 0) ? "   " : "", poly->segmentShifts[i], (((i % 16) == 15) || (i == (poly->segmentCount - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+        printf("// Coefficients of every segment, constant term first.\n");
+        printf("static const int32_t %sPolyCoefficients[] PRESSURE_FLASH_DATA = {\n", name);
+        for (uint32_t i = 0; i < coefficientCount; i++) {
+            printf("%s%11" PRId32 ",%s", ((i % 8) == 0) ? "   " : "", poly->coefficients[i], (((i % 8) == 7) || (i == (coefficientCount - 1))) ? "\n" : "");
+        }
+        printf("};\n\n");
+        printf("static const PressurePolyTable %sPoly PRESSURE_FLASH_DATA = {\n", name);
+        printf("    %sPolyCoefficients,\n    %sPolySegmentStarts,\n    %sPolySegmentShifts,\n", name, name, name);
+        printf("    %u,\n    %u,\n    %u,\n    %u,\n", poly->minADC, poly->maxADC, poly->segmentCount, poly->degree);
+        printf("    { INT64_C(%" PRId64 "), INT64_C(%" PRId64 ") }\n", fit->slope, fit->intercept);
+        printf("};\n\n");
+    }
+
+    // The descriptors in AVR program memory can only be read by the ...AVR(...) functions.
+    printf("#if defined(PRESSURE_FLASH_IN_PROGRAM_MEMORY) && !defined(PRESSURE_ALLOW_RAM_CONVERSIONS)\n");
+    printf("// The descriptors above are in program memory, which the functions below would read as RAM. Convert\n");
+    printf("// with ConvertADCReadingToPressureAVR(...) and ConvertADCBufferToPressureAVR(...) instead, or define\n");
+    printf("// PRESSURE_ALLOW_RAM_CONVERSIONS to convert with tables built in RAM in this translation unit.\n");
+    printf("#pragma GCC poison ConvertADCReadingToPressure ConvertADCBufferToPressure\n");
+    printf("#pragma GCC poison ConvertADCReadingToPressureQ ConvertADCBufferToPressureQ ConvertADCBufferToPressureDecimated\n");
+    printf("#pragma GCC poison PressureTracker_Init PressureTableSlot_Init PressureRing_Init ConvertADCBufferToPressurePacked\n");
+    printf("#pragma GCC poison ConvertADCReadingToPressureCompact ConvertADCBufferToPressureCompact\n");
+    printf("#pragma GCC poison ConvertADCReadingToPressurePoly ConvertADCBufferToPressurePoly\n");
+    printf("#endif\n\n");
+    printf("#endif // %s_H\n", prefix);
+}
+
+int main(int argc, char* argv[]) {
+    static PressureTableEntry entries[MAX_TABLE_ENTRIES];
+    static int32_t slopes[MAX_TABLE_ENTRIES];
+    static uint8_t indexSegments[PRESSURE_INDEX_BUCKETS(0, UINT16_MAX)];
+    static uint16_t eytzingerKeys[PRESSURE_EYTZINGER_SLOTS(MAX_TABLE_ENTRIES)];
+    static uint16_t eytzingerRanks[PRESSURE_EYTZINGER_SLOTS(MAX_TABLE_ENTRIES)];
+    static uint16_t compactADC[MAX_TABLE_ENTRIES];
+    static int16_t compactResiduals[MAX_TABLE_ENTRIES];
+    static uint16_t polySegmentStarts[POLY_FIT_MAX_SEGMENTS];
+    static uint8_t polySegmentShifts[POLY_FIT_MAX_SEGMENTS];
+    static int32_t polyCoefficients[POLY_FIT_MAX_COEFFICIENTS];
+    const char* name = "pressureTable";
+    const char* csvPath = NULL;
+    PressureFit fit;
+    PressureIndex index;
+    PressureEytzinger eytzinger;
+    PressureCompactTable compact;
+    int hasCompact;
+    int eytzingerRequested = 0;
+    PressureTable reference;
+    PressurePolyTable poly;
+    int32_t polyMaxError = -1;
+    int32_t polyError = -1;
+    int polyDegree = PRESSURE_POLY_MAX_DEGREE;
+    int polyMinRatio = 0;
+    unsigned long polyBytes;
+    unsigned long tableBytes;
+    int hasIndex;
+    int hasSlopes;
+    int16_t tableSize;
+    int entryCount;
+    FILE* csv;
+
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "--name") == 0) && ((i + 1) < argc)) {
+            name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--eytzinger") == 0) {
+            eytzingerRequested = 1;
+        }
+        else if ((strcmp(argv[i], "--poly-max-error") == 0) && ((i + 1) < argc)) {
+            polyMaxError = atoi(argv[++i]);
+            if (polyMaxError < 0) {
+                csvPath = NULL;
+                break;
+            }
+        }
+        else if ((strcmp(argv[i], "--poly-degree") == 0) && ((i + 1) < argc)) {
+            polyDegree = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--poly-min-ratio") == 0) && ((i + 1) < argc)) {
+            polyMinRatio = atoi(argv[++i]);
+        }
+        else if ((csvPath == NULL) && (argv[i][0] != '-')) {
+            csvPath = argv[i];
+        }
+        else {
+            csvPath = NULL;
+            break;
+        }
+    }
+    if ((csvPath == NULL) || !IsValidName(name) || (polyDegree < 1) || (polyDegree > PRESSURE_POLY_MAX_DEGREE) || (polyMinRatio < 0)) {
+        fprintf(stderr, "Usage: %s [--name <table symbol>] [--eytzinger] [--poly-max-error <error> [--poly-degree <1-%d>] [--poly-min-ratio <ratio>]]"
+                " <calibration.csv>\n",
+                argv[0], PRESSURE_POLY_MAX_DEGREE);
+        return -1;
+    }
+
+    csv = fopen(csvPath, "r");
+    if (csv == NULL) {
+        fprintf(stderr, "%s: cannot open calibration CSV\n", csvPath);
+        return -1;
+    }
+    entryCount = PressureCalibration_Read(csv, csvPath, entries);
+    fclose(csv);
+    if (entryCount < 0) {
+        return -1;
+    }
+    tableSize = (int16_t)(entryCount - 1);
+
+    PressureFit_Init(&fit, entries, tableSize);
+    // The index and the slopes are optional, so a table they cannot represent is still generated, and
+    // the conversion falls back to the binary search and the division respectively.
+    hasIndex = (PressureIndex_Init(&index, indexSegments, entries, tableSize) >= 0);
+    if (!hasIndex) {
+        fprintf(stderr, "%s: more than %d segments, the direct segment index is not generated\n", csvPath, UINT8_MAX);
+    }
+    hasSlopes = (PressureSlopes_Init(slopes, entries, tableSize) == 0);
+    if (!hasSlopes) {
+        fprintf(stderr, "%s: a pressure step does not fit in 15 bits, the segment slopes are not generated\n", csvPath);
+    }
+
+    // Without the index, the Eytzinger layout replaces the binary search over the table entries.
+    if (!hasIndex || eytzingerRequested) {
+        PressureEytzinger_Init(&eytzinger, eytzingerKeys, eytzingerRanks, entries, tableSize);
+    }
+
+    hasCompact = (PressureCompactTable_Init(&compact, compactADC, compactResiduals, entries, tableSize,
+                                            hasIndex ? &index : NULL, hasSlopes ? slopes : NULL) == 0);
+    if (!hasCompact) {
+        fprintf(stderr, "%s: the pressures are too far from evenly spaced, the compact table is not generated\n", csvPath);
+    }
+
+    if (polyMaxError >= 0) {
+        // The polynomials are checked against the conversion with the generated descriptor.
+        PressureTable_Init(&reference, entries, tableSize, hasIndex ? &index : NULL, hasSlopes ? slopes : NULL);
+        polyError = PressurePoly_Fit(&poly, polySegmentStarts, polySegmentShifts, polyCoefficients, &reference, (uint8_t)polyDegree, polyMaxError);
+        if (polyError < 0) {
+            fprintf(stderr, "%s: the piecewise-polynomial table could not be fitted\n", csvPath);
+            return -1;
+        }
+        polyBytes = poly.segmentCount * ((polyDegree + 1UL) * sizeof(int32_t) + sizeof(uint16_t) + sizeof(uint8_t));
+        tableBytes = (tableSize + 1UL) * sizeof(PressureTableEntry);
+        fprintf(stderr, "%s: %u polynomial segments of degree %d, maximum error %" PRId32 ", %lu bytes instead of %lu\n", csvPath,
+                poly.segmentCount, polyDegree, polyError, polyBytes, tableBytes);
+        if ((polyBytes * polyMinRatio) > tableBytes) {
+            fprintf(stderr, "%s: the piecewise-polynomial table is less than %d times smaller than the table\n", csvPath, polyMinRatio);
+            return -1;
+        }
+    }
+
+    EmitHeader(name, csvPath, entries, tableSize, &fit, hasIndex ? &index : NULL, hasSlopes ? slopes : NULL,
+               (!hasIndex || eytzingerRequested) ? &eytzinger : NULL, hasCompact ? &compact : NULL,
+               (polyError >= 0) ? &poly : NULL, polyError);
+    return 0;
+}
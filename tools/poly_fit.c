@@ -0,0 +1,291 @@
+/***************************************************************************************************
+* Module Name: Piecewise-Polynomial Fitter
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   This desktop module fits the piecewise-polynomial form of a Pressure-ADC table (see pressure_poly.c)
+*   for the table generator. The segments are placed from the first reading of the table onwards, each one
+*   as long as its polynomial meets the maximum error: its length is doubled until the fit fails, then
+*   bisected between the longest fit and the shortest failure, so the table is only split where the error
+*   bound requires it. A segment is fitted as follows:
+*     1. The polynomial of a segment is first fitted by least squares on every ADC reading of the
+*        segment, then refined towards the smallest maximum error with Lawson's reweighting, which
+*        converges to the minimax polynomial.
+*     2. After every step, the coefficients are rounded to fixed point and every ADC reading of the
+*        segment is converted with ConvertADCReadingToPressurePoly(...) itself, and compared with
+*        ConvertADCReadingToPressure(...) on the reference table.
+*   The error bound is therefore checked on the exact integer arithmetic the driver runs, not on the
+*   floating-point polynomial. Segments of 2 readings always meet any bound with a degree of 1 or more,
+*   so the fit cannot fail, although it may not compress the table.
+*
+***************************************************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "poly_fit.h"
+
+// Number of reweighting steps of Lawson's algorithm tried on a segment before shortening it.
+#define LAWSON_ITERATIONS 24
+
+/* Solves the (degree + 1) linear equations matrix * solution = vector by Gaussian elimination with
+*  partial pivoting. Returns 0 on success and -1 on a singular system.
+*/
+static int16_t SolveLinearSystem(double matrix[PRESSURE_POLY_MAX_DEGREE + 1][PRESSURE_POLY_MAX_DEGREE + 1],
+                                 double* vector, double* solution, uint8_t degree) {
+    const int16_t size = degree + 1;
+
+    for (int16_t column = 0; column < size; column++) {
+        int16_t pivot = column;
+        for (int16_t row = column + 1; row < size; row++) {
+            if (fabs(matrix[row][column]) > fabs(matrix[pivot][column])) {
+                pivot = row;
+            }
+        }
+        if (matrix[pivot][column] == 0.0) {
+            return -1;
+        }
+        for (int16_t k = 0; k < size; k++) {
+            double swap = matrix[column][k];
+            matrix[column][k] = matrix[pivot][k];
+            matrix[pivot][k] = swap;
+        }
+        double swap = vector[column];
+        vector[column] = vector[pivot];
+        vector[pivot] = swap;
+
+        for (int16_t row = column + 1; row < size; row++) {
+            double factor = matrix[row][column] / matrix[column][column];
+            for (int16_t k = column; k < size; k++) {
+                matrix[row][k] -= factor * matrix[column][k];
+            }
+            vector[row] -= factor * vector[column];
+        }
+    }
+    for (int16_t row = size - 1; row >= 0; row--) {
+        double value = vector[row];
+        for (int16_t k = row + 1; k < size; k++) {
+            value -= matrix[row][k] * solution[k];
+        }
+        solution[row] = value / matrix[row][row];
+    }
+    return 0;
+}
+
+/* Fits the polynomial of the position t in [0, 1) that minimizes the weighted squared error to the
+*  pressures of the segment. Returns 0 on success and -1 on a singular system.
+*/
+static int16_t FitWeightedLeastSquares(const double* positions, const int32_t* pressures, const double* weights, uint32_t count,
+                                       uint8_t degree, double* polynomial) {
+    double matrix[PRESSURE_POLY_MAX_DEGREE + 1][PRESSURE_POLY_MAX_DEGREE + 1] = { { 0.0 } };
+    double vector[PRESSURE_POLY_MAX_DEGREE + 1] = { 0.0 };
+
+    for (uint32_t i = 0; i < count; i++) {
+        double powers[2 * PRESSURE_POLY_MAX_DEGREE + 1];
+        powers[0] = weights[i];
+        for (int16_t k = 1; k <= 2 * degree; k++) {
+            powers[k] = powers[k - 1] * positions[i];
+        }
+        for (int16_t row = 0; row <= degree; row++) {
+            for (int16_t column = 0; column <= degree; column++) {
+                matrix[row][column] += powers[row + column];
+            }
+            vector[row] += powers[row] * pressures[i];
+        }
+    }
+    return SolveLinearSystem(matrix, vector, polynomial, degree);
+}
+
+/* Rounds the polynomial to the fixed-point coefficients of the segment. Returns 0 on success and -1
+*  if a coefficient does not fit in 32 bits.
+*/
+static int16_t QuantizeCoefficients(const double* polynomial, uint8_t degree, int32_t* coefficients) {
+    for (int16_t k = 0; k <= degree; k++) {
+        double scaled = nearbyint(ldexp(polynomial[k], PRESSURE_POLY_COEFFICIENT_SHIFT));
+        if ((scaled > INT32_MAX) || (scaled < INT32_MIN)) {
+            return -1;
+        }
+        coefficients[k] = (int32_t)scaled;
+    }
+    return 0;
+}
+
+/* Converts every reading of the segment with the fixed-point coefficients, stores the errors from the
+*  reference pressures and returns the largest one.
+*/
+static int32_t CheckSegment(const PressurePolyTable* polyPtr, uint16_t firstADC, const int32_t* pressures, uint32_t count, int32_t* errors) {
+    int32_t maxError = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        errors[i] = abs(ConvertADCReadingToPressurePoly(firstADC + (int)i, polyPtr) - pressures[i]);
+        if (errors[i] > maxError) {
+            maxError = errors[i];
+        }
+    }
+    return maxError;
+}
+
+/* Fits the coefficients of one segment, returning the largest error of the readings of the segment,
+*  or -1 if no polynomial within maxError was found.
+*/
+static int32_t FitSegment(PressurePolyTable* polyPtr, int32_t* coefficients, uint8_t segmentShift, uint16_t firstADC, const int32_t* pressures,
+                          uint32_t count, int32_t maxError, double* positions, double* weights, int32_t* errors) {
+    // A short last segment is fitted with a lower degree, leaving the higher coefficients at 0.
+    const uint8_t degree = ((count - 1) < polyPtr->degree) ? (uint8_t)(count - 1) : polyPtr->degree;
+    double polynomial[PRESSURE_POLY_MAX_DEGREE + 1] = { 0.0 };
+
+    for (uint32_t i = 0; i < count; i++) {
+        positions[i] = ldexp((double)i, -segmentShift);
+        weights[i] = 1.0 / count;
+    }
+    for (int16_t iteration = 0; iteration <= LAWSON_ITERATIONS; iteration++) {
+        double weightSum = 0.0;
+        int32_t segmentError;
+
+        if ((FitWeightedLeastSquares(positions, pressures, weights, count, degree, polynomial) != 0) ||
+            (QuantizeCoefficients(polynomial, polyPtr->degree, coefficients) != 0)) {
+            return -1;
+        }
+        segmentError = CheckSegment(polyPtr, firstADC, pressures, count, errors);
+        if (segmentError <= maxError) {
+            return segmentError;
+        }
+
+        // Lawson's step: the weight of every reading grows with its error, on the unrounded polynomial.
+        for (uint32_t i = 0; i < count; i++) {
+            double value = polynomial[degree];
+            for (int16_t k = (int16_t)degree - 1; k >= 0; k--) {
+                value = value * positions[i] + polynomial[k];
+            }
+            weights[i] *= fabs(value - pressures[i]);
+            weightSum += weights[i];
+        }
+        if (weightSum == 0.0) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            weights[i] /= weightSum;
+        }
+    }
+    return -1;
+}
+
+/* Returns the base 2 logarithm of the smallest power of two at least as large as the segment length. */
+static uint8_t SegmentShift(uint32_t count) {
+    uint8_t segmentShift = 0;
+
+    while ((1UL << segmentShift) < count) {
+        segmentShift++;
+    }
+    return segmentShift;
+}
+
+/* Fits the last segment of the table, of count readings from firstADC, within maxError. Returns the
+*  largest error of its readings, or -1 if no polynomial within maxError was found.
+*/
+static int32_t FitLastSegment(PressurePolyTable* polyPtr, uint16_t* segmentStarts, uint8_t* segmentShifts, int32_t* coefficients,
+                              uint32_t first, const int32_t* pressures, uint32_t count, int32_t maxError, double* positions,
+                              double* weights, int32_t* errors) {
+    const uint16_t segment = polyPtr->segmentCount - 1;
+
+    segmentStarts[segment] = (uint16_t)(polyPtr->minADC + first);
+    segmentShifts[segment] = SegmentShift(count);
+    return FitSegment(polyPtr, &coefficients[segment * (polyPtr->degree + 1u)], segmentShifts[segment], segmentStarts[segment],
+                      &pressures[first], count, maxError, positions, weights, errors);
+}
+
+/* This function fits the piecewise-polynomial form of the reference table with the given degree (1 to
+*  PRESSURE_POLY_MAX_DEGREE), with segments as long as possible for which no ADC reading within the table
+*  bounds is converted more than maxError (in 0.01 KPa) away from ConvertADCReadingToPressure(...).
+*  The segmentStarts and segmentShifts arrays must hold POLY_FIT_MAX_SEGMENTS values, and the coefficients
+*  array POLY_FIT_MAX_COEFFICIENTS values. Returns the largest error of the fitted table, or -1 on invalid
+*  arguments or on memory allocation failure.
+*/
+int32_t PressurePoly_Fit(PressurePolyTable* polyPtr, uint16_t* segmentStarts, uint8_t* segmentShifts, int32_t* coefficients,
+                         const PressureTable* referencePtr, uint8_t degree, int32_t maxError) {
+    const uint16_t minADC = referencePtr->entries[0].adc;
+    const uint16_t maxADC = referencePtr->entries[referencePtr->tableSize].adc;
+    const uint32_t readingCount = (uint32_t)(maxADC - minADC) + 1;
+    int32_t* pressures;
+    int32_t* errors;
+    double* positions;
+    double* weights;
+    int32_t tableError = 0;
+
+    if ((degree < 1) || (degree > PRESSURE_POLY_MAX_DEGREE) || (maxError < 0)) {
+        return -1;
+    }
+    pressures = malloc(readingCount * sizeof(*pressures));
+    errors = malloc(readingCount * sizeof(*errors));
+    positions = malloc(readingCount * sizeof(*positions));
+    weights = malloc(readingCount * sizeof(*weights));
+    if ((pressures == NULL) || (errors == NULL) || (positions == NULL) || (weights == NULL)) {
+        free(pressures);
+        free(errors);
+        free(positions);
+        free(weights);
+        return -1;
+    }
+    for (uint32_t i = 0; i < readingCount; i++) {
+        pressures[i] = ConvertADCReadingToPressure(minADC + (int)i, referencePtr);
+    }
+
+    polyPtr->coefficients = coefficients;
+    polyPtr->segmentStarts = segmentStarts;
+    polyPtr->segmentShifts = segmentShifts;
+    polyPtr->minADC = minADC;
+    polyPtr->maxADC = maxADC;
+    polyPtr->segmentCount = 0;
+    polyPtr->degree = degree;
+    polyPtr->fit = referencePtr->fit;
+    // Every segment is the last one while it is fitted, so that CheckSegment(...) converts its readings
+    // with the table as the driver will see it.
+    for (uint32_t first = 0; first < readingCount; ) {
+        const uint32_t remaining = readingCount - first;
+        // Segments of up to 2 readings always meet the bound, longer ones are searched for.
+        uint32_t fitted = (remaining < 2) ? remaining : 2;
+        uint32_t failed = 0;
+        int32_t segmentError;
+
+        polyPtr->segmentCount++;
+        while ((failed == 0) && (fitted < remaining)) {
+            const uint32_t count = ((remaining / 2) < fitted) ? remaining : (fitted * 2);
+            if (FitLastSegment(polyPtr, segmentStarts, segmentShifts, coefficients, first, pressures, count, maxError, positions, weights,
+                               errors) >= 0) {
+                fitted = count;
+            }
+            else {
+                failed = count;
+            }
+        }
+        while (failed > (fitted + 1)) {
+            const uint32_t count = fitted + (failed - fitted) / 2;
+            if (FitLastSegment(polyPtr, segmentStarts, segmentShifts, coefficients, first, pressures, count, maxError, positions, weights,
+                               errors) >= 0) {
+                fitted = count;
+            }
+            else {
+                failed = count;
+            }
+        }
+        // The last attempt may have failed, so the longest fit is fitted again.
+        segmentError = FitLastSegment(polyPtr, segmentStarts, segmentShifts, coefficients, first, pressures, fitted, maxError, positions,
+                                      weights, errors);
+        if (segmentError < 0) {
+            tableError = -1;
+            break;
+        }
+        if (segmentError > tableError) {
+            tableError = segmentError;
+        }
+        first += fitted;
+    }
+
+    free(pressures);
+    free(errors);
+    free(positions);
+    free(weights);
+    return tableError;
+}
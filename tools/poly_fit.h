@@ -0,0 +1,25 @@
+/***************************************************************************************************
+* Module Name: Piecewise-Polynomial Fitter
+*
+* Author: Hooman Tahmasebipour
+* Date: September, 2023
+*
+* Module Description:
+*   Offline fit of the piecewise-polynomial form of a Pressure-ADC table (see tools/poly_fit.c).
+*
+***************************************************************************************************/
+
+#ifndef POLY_FIT_H
+#define POLY_FIT_H
+
+#include "pressure_sensor.h"
+
+// Largest number of segments and coefficients PressurePoly_Fit(...) may emit, for the shortest segments
+// (2 readings).
+#define POLY_FIT_MAX_SEGMENTS (((uint32_t)UINT16_MAX >> 1) + 1)
+#define POLY_FIT_MAX_COEFFICIENTS (POLY_FIT_MAX_SEGMENTS * (PRESSURE_POLY_MAX_DEGREE + 1))
+
+int32_t PressurePoly_Fit(PressurePolyTable* polyPtr, uint16_t* segmentStarts, uint8_t* segmentShifts, int32_t* coefficients,
+                         const PressureTable* referencePtr, uint8_t degree, int32_t maxError);
+
+#endif // POLY_FIT_H